@@ -0,0 +1,185 @@
+#!/bin/bash
+# Benchmarks for frame, on large binary images of random pixels.  The
+# kernels benchmark frames one image with each shading kernel, the
+# threads benchmark frames it with more and more threads, and the
+# tiles benchmark compares raster and --tiled mode at a few image
+# sizes, and the batch benchmark frames a directory of thumbnails with
+# a shell loop and with --batch.  Each reports the best time of a few
+# runs, the rate in megapixels per second and the speedup, and checks
+# that every run gives the same image.  With an argument, only that
+# benchmark runs.  BENCH_SIZE, BENCH_THREADS, BENCH_TILE_SIZES,
+# BENCH_THUMB, BENCH_THUMBS and BENCH_RUNS change what they try.
+SIZE=${BENCH_SIZE:-4000x3000}
+THREADS=${BENCH_THREADS:-"1 2 4 8 16"}
+TILE_SIZES=${BENCH_TILE_SIZES:-"1000x750 4000x3000 12000x9000"}
+THUMB=${BENCH_THUMB:-160x120}
+THUMBS=${BENCH_THUMBS:-500}
+RUNS=${BENCH_RUNS:-5}
+WHICH=${1:-all}
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# Make a random binary image of the given size, WIDTHxHEIGHT.
+makeImage() {
+  WIDTH=${1%x*}
+  HEIGHT=${1#*x}
+  printf "P6\n%d %d\n255\n" $WIDTH $HEIGHT > $WORK/input.ppm
+  head -c $(( WIDTH * HEIGHT * 3 )) /dev/urandom >> $WORK/input.ppm
+
+  # Every way of framing it has to give the same image.
+  ./frame < $WORK/input.ppm > $WORK/expected.ppm || exit 1
+}
+
+# Time a command, leaving the best time of a few runs in BEST.
+timeRuns() {
+  BEST=""
+  for (( r = 0; r < RUNS; r++ )) ; do
+    START=$(date +%s.%N)
+    "$@"
+    END=$(date +%s.%N)
+    TIME=$(awk "BEGIN { printf \"%.4f\", $END - $START }")
+    if [ -z "$BEST" ] || awk "BEGIN { exit !( $TIME < $BEST ) }" ; then
+        BEST=$TIME
+    fi
+  done
+}
+
+# Frame the current image with the given options.
+runFrame() {
+  ./frame "$@" < $WORK/input.ppm > $WORK/output.ppm
+}
+
+# Time frame with the given options on the current image, leaving the
+# best time in BEST.
+timeFrame() {
+  timeRuns runFrame "$@"
+
+  if ! cmp -s $WORK/expected.ppm $WORK/output.ppm ; then
+      echo "**** frame $* gave a different image"
+      exit 1
+  fi
+}
+
+# Rate in megapixels per second for the current image and time.
+rate() {
+  awk "BEGIN { printf \"%.1f\", $WIDTH * $HEIGHT / 1e6 / $1 }"
+}
+
+benchKernels() {
+  makeImage $SIZE
+  echo "Shading kernels on a ${WIDTH}x${HEIGHT} binary image"
+  printf "%-8s %10s %10s %10s\n" kernel "time (s)" "MP/s" speedup
+  BASE=""
+  for K in scalar sse2 avx2 ; do
+    export FRAME_KERNEL=$K
+    timeFrame
+    if [ -z "$BASE" ] ; then
+        BASE=$BEST
+    fi
+    SPEEDUP=$(awk "BEGIN { printf \"%.2fx\", $BASE / $BEST }")
+    printf "%-8s %10s %10s %10s\n" $K $BEST $(rate $BEST) $SPEEDUP
+  done
+  unset FRAME_KERNEL
+}
+
+benchThreads() {
+  makeImage $SIZE
+  echo "Framing a ${WIDTH}x${HEIGHT} binary image on $(nproc) cores"
+  printf "%-8s %10s %10s %10s\n" threads "time (s)" "MP/s" speedup
+  BASE=""
+  for J in $THREADS ; do
+    timeFrame -j $J
+    if [ -z "$BASE" ] ; then
+        BASE=$BEST
+    fi
+    SPEEDUP=$(awk "BEGIN { printf \"%.2fx\", $BASE / $BEST }")
+    printf "%-8s %10s %10s %10s\n" $J $BEST $(rate $BEST) $SPEEDUP
+  done
+}
+
+benchTiles() {
+  echo "Raster and tiled framing of binary images"
+  printf "%-12s %10s %10s %10s %10s %10s\n" size "raster (s)" "MP/s" "tiled (s)" "MP/s" speedup
+  for S in $TILE_SIZES ; do
+    makeImage $S
+    timeFrame
+    RASTER=$BEST
+    timeFrame --tiled
+    SPEEDUP=$(awk "BEGIN { printf \"%.2fx\", $RASTER / $BEST }")
+    printf "%-12s %10s %10s %10s %10s %10s\n" $S $RASTER $(rate $RASTER) $BEST $(rate $BEST) \
+           $SPEEDUP
+  done
+  rm -f $WORK/*.ppm
+}
+
+# Frame each thumbnail with its own run of frame.
+frameLoop() {
+  for F in $WORK/thumbs/*.ppm ; do
+    ./frame < $F > $WORK/out/${F##*/}
+  done
+}
+
+# Check that the framed thumbnails match the ones from the shell loop.
+checkThumbs() {
+  if ! diff -rq $WORK/expected $WORK/out > /dev/null ; then
+      echo "**** frame $* gave different images"
+      exit 1
+  fi
+}
+
+benchBatch() {
+  mkdir -p $WORK/thumbs $WORK/out $WORK/expected
+  for (( t = 0; t < THUMBS; t++ )) ; do
+    makeImage $THUMB
+    mv $WORK/input.ppm $WORK/thumbs/$t.ppm
+    mv $WORK/expected.ppm $WORK/expected/$t.ppm
+  done
+  PIXELS=$(( WIDTH * HEIGHT * THUMBS ))
+
+  echo "Framing $THUMBS ${THUMB} binary images on $(nproc) cores"
+  printf "%-16s %10s %10s %10s\n" mode "time (s)" "MP/s" speedup
+  timeRuns frameLoop
+  checkThumbs
+  BASE=$BEST
+  printf "%-16s %10s %10s %10s\n" loop $BEST \
+         $(awk "BEGIN { printf \"%.1f\", $PIXELS / 1e6 / $BEST }") 1.00x
+  JOBS=1
+  if [ $(nproc) -gt 1 ] ; then
+      JOBS="1 $(nproc)"
+  fi
+  for J in $JOBS ; do
+    rm -f $WORK/out/*
+    timeRuns ./frame -j $J --batch $WORK/out $WORK/thumbs
+    checkThumbs --batch -j $J
+    SPEEDUP=$(awk "BEGIN { printf \"%.2fx\", $BASE / $BEST }")
+    printf "%-16s %10s %10s %10s\n" "batch -j $J" $BEST \
+           $(awk "BEGIN { printf \"%.1f\", $PIXELS / 1e6 / $BEST }") $SPEEDUP
+  done
+  rm -rf $WORK/thumbs $WORK/out $WORK/expected
+}
+
+# make a fresh copy of the program
+make frame > /dev/null || exit 1
+
+if [ $WHICH = all ] || [ $WHICH = kernels ] ; then
+    benchKernels
+fi
+if [ $WHICH = all ] ; then
+    echo
+fi
+if [ $WHICH = all ] || [ $WHICH = threads ] ; then
+    benchThreads
+fi
+if [ $WHICH = all ] ; then
+    echo
+fi
+if [ $WHICH = all ] || [ $WHICH = tiles ] ; then
+    benchTiles
+fi
+if [ $WHICH = all ] ; then
+    echo
+fi
+if [ $WHICH = all ] || [ $WHICH = batch ] ; then
+    benchBatch
+fi
@@ -1,116 +1,1556 @@
 /**
    @file frame.c
    @author Prem Subedi
-   This programs wraps the image with blue color circular frame. 
+   This programs wraps the image with blue color circular frame, or
+   with --frame, an elliptical or rounded rectangle one in any color.
+   Images can be ASCII (P3) or binary (P6) PPM, with up to 16 bits per
+   sample, and the output can be written in either format.  It frames
+   standard input, or with --batch, a list of files and directories,
+   which are shared out between a pool of threads.  Batches are fastest
+   when the images are the same size, since the blend weights are only
+   worked out once for each size and the buffers are reused.  Each image
+   is streamed through a row at a time.  ASCII input is read in large
+   blocks and scanned for integers by hand, binary input from a file
+   is mapped into memory, and each output row is built in a buffer and
+   written all at once, so memory use is bounded by one row no matter
+   how big the image is.
  */
 
-#include <math.h>
-#include <ctype.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <dirent.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "frame.h"
+#include "shade.h"
 #define EXIT_STATUS1 100
 #define EXIT_STATUS2 101
 #define EXIT_STATUS3 102
-#define LOCATION 0.5
 #define MAX_INTENSITY 255
 #define THREE_VALUE 3
 
-double fRadius; /* Radius of the frame */
-double cornerDist;  /* Distance from the center of the image to the pixel at the corner */
+/** Largest maximum sample value PPM allows, for 16-bit samples. */
+#define MAX_MAXVAL 65535
+
+/** Size of the blocks the input is read in. */
+#define BLOCK_SIZE 65536
+
+/** Input kept in the buffer while scanning for an integer, more than
+    enough for any number that fits in an int. */
+#define NUMBER_ROOM 64
+
+/** Fewest characters written for each color component, "%3d ". */
+#define COMPONENT_WIDTH 4
+
+/** About how many samples go in each band of rows, when the image is
+    split up between threads. */
+#define BAND_SAMPLES 196608
+
+/** Size of a tile in --tiled mode, in pixels.  A tile is small enough
+    to stay in cache while it's framed, even for very wide images. */
+#define TILE_WIDTH 256
+#define TILE_HEIGHT 32
+
+/** Number of bands in flight for each thread, so there's always work
+    waiting while the finished bands are written out. */
+#define BANDS_PER_THREAD 4
+
+/** An input file, either mapped into memory or read a block at a time. */
+typedef struct {
+   /** File being read. */
+   FILE *fp;
+
+   /** The whole input if it's mapped, or the current block. */
+   unsigned char *data;
+
+   /** Index of the next character to use. */
+   size_t pos;
+
+   /** Number of characters in data. */
+   size_t len;
+
+   /** True if the whole input is mapped. */
+   bool mapped;
+
+   /** True once we've tried to read past the end of the input. */
+   bool eof;
+} Reader;
+
+/** Buffer for one row of output. */
+typedef struct {
+   /** File the rows are written to. */
+   FILE *fp;
+
+   /** Formatted text or binary samples for the row. */
+   unsigned char *data;
+
+   /** Number of bytes in the buffer. */
+   size_t len;
+} Writer;
+
+/** Size and format of an image. */
+typedef struct {
+   /** 3 for ASCII PPM, 6 for binary. */
+   int format;
+
+   /** Width and height in pixels. */
+   int width;
+   int height;
+
+   /** Largest value of a sample. */
+   int maxval;
+
+   /** Bytes per sample in binary PPM, 1 or 2. */
+   int bytes;
+} Image;
+
+/** Everything needed to frame the rows of one image.  It's only read
+    while the rows are framed, so all the threads working on the image
+    can share it. */
+typedef struct {
+   /** The image being framed. */
+   Image img;
+
+   /** 3 or 6 to write ASCII or binary. */
+   int outFormat;
+
+   /** Blend weights for the image's size. */
+   WeightTable const *weights;
+
+   /** True to frame binary input to binary output a tile at a time. */
+   bool tiled;
+
+   /** Frame color, scaled to the image's maximum sample value. */
+   int border[ RING_CHANNELS ];
+} FrameJob;
+
+/** A buffer that only grows, so it can be used again for the next image. */
+typedef struct {
+   void *data;
+   size_t cap;
+} Buffer;
+
+/** Buffers for framing an image in one thread, kept from one image to
+    the next. */
+typedef struct {
+   /** Samples for a row. */
+   Buffer samples;
+
+   /** Bytes of binary input, if they have to be copied. */
+   Buffer bytes;
+
+   /** Formatted output. */
+   Buffer out;
+} Buffers;
+
+/** Options from the command line. */
+typedef struct {
+   /** 3 or 6 to write ASCII or binary, or 0 for the same format as the input. */
+   int outFormat;
+
+   /** Number of threads to frame each image with, or in a batch, the
+       number of images to frame at once. */
+   int threads;
+
+   /** True to report how long each image in a batch took. */
+   bool stats;
+
+   /** True to frame binary images a tile at a time. */
+   bool tiled;
+
+   /** What the frame looks like. */
+   FrameSpec spec;
+} Options;
+
+/** A band of rows, framed by one worker thread. */
+typedef struct {
+   /** Index of the first row, and the number of rows. */
+   int first;
+   int rows;
+
+   /** Samples for all the rows. */
+   int *samples;
+
+   /** For binary input, the bytes of the rows, which the worker turns
+       into samples.  For ASCII input this is NULL, and the samples
+       are already read. */
+   unsigned char const *bytes;
+
+   /** Room for the bytes of binary input, if they have to be copied. */
+   unsigned char *buf;
+
+   /** The framed rows, formatted for output. */
+   Writer out;
+
+   /** False if a sample was out of range. */
+   bool ok;
+
+   /** True once the band is framed and can be written. */
+   bool done;
+} Band;
+
+/** State shared by the worker threads framing one image.  Bands are
+    numbered from the top of the image, and band b uses slot
+    b % slots, so there's a fixed number of them in memory at once. */
+typedef struct {
+   /** The image, and how to frame it. */
+   FrameJob const *job;
+
+   /** Slots for the bands in flight. */
+   Band *bands;
+   int slots;
+
+   /** Number of bands that have been read, and can be started. */
+   int ready;
+
+   /** Index of the next band to start. */
+   int next;
+
+   /** True once there are no more bands coming. */
+   bool finished;
+
+   /** Lock for everything above, and for the done flag in each band. */
+   pthread_mutex_t lock;
+
+   /** Signaled whenever a band is ready, or finishes. */
+   pthread_cond_t changed;
+} BandPool;
+
+/** An image in a batch. */
+typedef struct {
+   /** Names of the input and output files, and the temporary file the
+       output is written to until it's done. */
+   char const *path;
+   char *outName;
+   char *tmpName;
+
+   /** Size of the image, once its header is read. */
+   Image img;
+
+   /** Exit status for the image, and how long it took to frame. */
+   int status;
+   double seconds;
+
+   /** True once the image is framed. */
+   bool done;
+} BatchItem;
+
+/** State shared by the worker threads framing a batch.  Each worker
+    takes the next image in the list until they're all taken. */
+typedef struct {
+   /** The images. */
+   BatchItem *items;
+   int count;
+
+   /** Index of the next image to take. */
+   int next;
+
+   /** How to frame them. */
+   Options const *opts;
+
+   /** Lock for everything above, and for the done flag in each image. */
+   pthread_mutex_t lock;
+
+   /** Signaled whenever an image is done. */
+   pthread_cond_t finished;
+} Batch;
+
+/**
+   Return the current time in seconds, from a monotonic clock.
+   @return current time.
+ */
+static double now() {
+   struct timespec ts;
+   clock_gettime( CLOCK_MONOTONIC, &ts );
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+   Make sure a buffer can hold at least the given number of bytes.
+   @param buf the buffer.
+   @param size number of bytes needed.
+   @return the buffer's memory, or NULL if there's not enough.
+ */
+static void *reserve( Buffer *buf, size_t size ) {
+   if ( size > buf->cap ) {
+      void *data = realloc( buf->data, size );
+      if ( data == NULL ) {
+         return NULL;
+      }
+      buf->data = data;
+      buf->cap = size;
+   }
+   return buf->data;
+}
+
+/**
+   Free the memory for a set of buffers.
+   @param bufs the buffers.
+ */
+static void freeBuffers( Buffers *bufs ) {
+   free( bufs->samples.data );
+   free( bufs->bytes.data );
+   free( bufs->out.data );
+}
+
+/**
+   Get ready to read a file.  If it's a regular file, it's mapped, so
+   binary samples can be used right where they are.
+   @param in reader to initialize.
+   @param fp file to read.
+ */
+static void openReader( Reader *in, FILE *fp ) {
+   in->fp = fp;
+   in->pos = 0;
+   in->len = 0;
+   in->mapped = false;
+   in->eof = false;
+
+   // The image starts wherever the file is now, which isn't the start
+   // if something else has already read part of it.
+   struct stat st;
+   off_t offset = ftello( fp );
+   if ( fstat( fileno( fp ), &st ) == 0 && S_ISREG( st.st_mode ) && offset >= 0 &&
+        offset < st.st_size ) {
+      void *data = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno( fp ), 0 );
+      if ( data != MAP_FAILED ) {
+         in->data = (unsigned char *) data;
+         in->pos = offset;
+         in->len = st.st_size;
+         in->mapped = true;
+         return;
+      }
+   }
+   in->data = (unsigned char *) malloc( BLOCK_SIZE );
+}
+
+/**
+   Free the memory for a reader, or unmap its file.
+   @param in reader to close.
+ */
+static void closeReader( Reader *in ) {
+   if ( in->mapped ) {
+      munmap( in->data, in->len );
+   } else {
+      free( in->data );
+   }
+}
+
+/**
+   Move the unread input to the start of the buffer, and read as much
+   more as will fit after it.  This does nothing for mapped input.
+   @param in input to refill.
+ */
+static void refillReader( Reader *in ) {
+   if ( in->mapped || in->eof ) {
+      return;
+   }
+   memmove( in->data, in->data + in->pos, in->len - in->pos );
+   in->len -= in->pos;
+   in->pos = 0;
+   size_t n = fread( in->data + in->len, 1, BLOCK_SIZE - in->len, in->fp );
+   in->len += n;
+   in->eof = n == 0;
+}
+
+/**
+   Make sure there's unread input in the buffer, reading the next block
+   if we've used up the last one.
+   @param in input to fill.
+   @return false at the end of the input.
+ */
+static bool fillReader( Reader *in ) {
+   if ( in->pos == in->len ) {
+      refillReader( in );
+   }
+   return in->pos < in->len;
+}
+
+/**
+   Return the next character of input without using it up.
+   @param in input to look at.
+   @return the next character, or EOF at the end of the input.
+ */
+static int peekChar( Reader *in ) {
+   return fillReader( in ) ? in->data[ in->pos ] : EOF;
+}
 
 /**
-   Shades the pixels based on their original color, frame color and distance from their center.
-   @param color pixel's original color.
-   @param borderColor new frame color to be added.
-   @param dist pixel's distance from the center of the frame.
+   Return true if the given character is whitespace, as isspace()
+   would for the C locale.
+   @param c the character.
+   @return true if it's whitespace.
  */
-void shade( int color, int borderColor, double dist ) {
-   double w = (dist - fRadius) /(cornerDist - fRadius);
-   double result = (double)(borderColor * w) + (double)(color * (1 - w)); 
-   int newColor = round(result);
-   printf("%4d", newColor);
+static bool isSpace( int c ) {
+   return c == ' ' || ( c >= '\t' && c <= '\r' );
 }
 
 /**
-   Checks the file type of an image if it's starts with two characters P3 
-   or not. It not it exits the program with exit value of 100.
+   Read an integer from the input, the way scanf's %d does, skipping
+   any whitespace before it.  This scans the buffer with a pointer, and
+   only goes back to the input when there's too little left in it for
+   a number.  Values too big for an int are clamped.
+   @param in input to read from.
+   @param val where to store the integer.
+   @return true if there was an integer to read.
  */
-void checkFileType() {
-   int c1 = getchar();
-   int c2 = getchar();
-   if (c1 != 'P' || c2 != '3') {
-      exit(EXIT_STATUS1);
+static bool readInt( Reader *in, int *val ) {
+   // Skip whitespace, which may take more than one buffer.
+   unsigned char const *p, *end;
+   for ( ;; ) {
+      p = in->data + in->pos;
+      end = in->data + in->len;
+      while ( p < end && isSpace( *p ) ) {
+         p++;
+      }
+      in->pos = p - in->data;
+      if ( in->len - in->pos >= NUMBER_ROOM || in->mapped || in->eof ) {
+         if ( p < end || in->mapped || in->eof ) {
+            break;
+         }
+      }
+      refillReader( in );
+   }
+   p = in->data + in->pos;
+   end = in->data + in->len;
+
+   bool neg = false;
+   if ( p < end && ( *p == '-' || *p == '+' ) ) {
+      neg = *p == '-';
+      p++;
+   }
+   if ( p == end || (unsigned) ( *p - '0' ) > 9 ) {
+      in->pos = p - in->data;
+      return false;
+   }
+
+   long v = 0;
+   while ( p < end && (unsigned) ( *p - '0' ) <= 9 ) {
+      v = v <= INT_MAX / 10 ? v * 10 + ( *p - '0' ) : INT_MAX;
+      p++;
    }
-   printf("%c", c1);
-   printf("%c\n", c2);
+   in->pos = p - in->data;
+   *val = neg ? -v : v;
+   return true;
 }
-  
+
 /**
-   Starting point of the program, which calls it's helper functions and adds the 
-   frame over the image.
+   Read an integer from the header, where there can also be comments
+   from a # to the end of the line.
+   @param in input to read from.
+   @param val where to store the integer.
+   @return true if there was an integer to read.
  */
-int main() {
-   checkFileType();
-   int ch1;
-   int ch2;
-   
-   if (scanf("%d %d", &ch1, &ch2) != 2) {
-      exit(EXIT_STATUS2);
+static bool readHeaderInt( Reader *in, int *val ) {
+   int c = peekChar( in );
+   while ( isSpace( c ) || c == '#' ) {
+      if ( c == '#' ) {
+         while ( c != '\n' && c != EOF ) {
+            in->pos++;
+            c = peekChar( in );
+         }
+      } else {
+         in->pos++;
+         c = peekChar( in );
+      }
    }
-   printf("%d ", ch1);
-   printf("%d\n", ch2);
-   if (ch1 < 2 || ch2 < 2) {
-      exit(EXIT_STATUS2);
+   return readInt( in, val );
+}
+
+/**
+   Return the binary samples for the next row.  For mapped input, they
+   are used right where they are, otherwise they're copied into the
+   given buffer.
+   @param in input to read from.
+   @param buf room for the row, if it has to be copied.
+   @param n number of bytes in the row.
+   @return the row, or NULL if the input ends first.
+ */
+static unsigned char const *readBytes( Reader *in, unsigned char *buf, size_t n ) {
+   if ( in->mapped ) {
+      if ( in->len - in->pos < n ) {
+         return NULL;
+      }
+      in->pos += n;
+      return in->data + in->pos - n;
    }
-   int maxIntensity;
-   int value = scanf("%d\n", &maxIntensity);
-   if (value != 1){
-      exit(EXIT_STATUS2);
+
+   for ( size_t got = 0; got < n; ) {
+      if ( !fillReader( in ) ) {
+         return NULL;
+      }
+      size_t k = in->len - in->pos < n - got ? in->len - in->pos : n - got;
+      memcpy( buf + got, in->data + in->pos, k );
+      in->pos += k;
+      got += k;
    }
-   printf("%d\n", maxIntensity);
-    
-   double x = LOCATION;
-   double y = LOCATION;
+   return buf;
+}
 
-   double centerX = ch1/ 2;
-   double centerY = ch2/ 2;
-   if (ch1 <= ch2) {
-      fRadius = (ch1 - 1) / 2;
+/**
+   Read one row of samples from ASCII input.
+   @param in input to read from.
+   @param img the image.
+   @param row where to store the samples.
+   @return false if there aren't enough samples, or one is out of range.
+ */
+static bool readRowP3( Reader *in, Image const *img, int *row ) {
+   int n = img->width * THREE_VALUE;
+   for ( int k = 0; k < n; k++ ) {
+      if ( !readInt( in, row + k ) || row[ k ] < 0 || row[ k ] > img->maxval ) {
+         return false;
+      }
+   }
+   return true;
+}
+
+/**
+   Turn binary samples into integers.  Two-byte samples are most
+   significant byte first.
+   @param img the image.
+   @param p bytes of the samples.
+   @param row where to store the samples.
+   @param n number of samples.
+   @return false if a sample is out of range.
+ */
+static bool decodeSamples( Image const *img, unsigned char const *p, int *row, int n ) {
+   if ( img->bytes == 1 ) {
+      for ( int k = 0; k < n; k++ ) {
+         row[ k ] = p[ k ];
+      }
    } else {
-      fRadius = (ch2 - 1) / 2;
-   }
-
-   cornerDist = sqrt((x - centerX) * (x - centerX) + (y - centerY) * (y - centerY));
-   
-   for (int i = 0; i < ch2; i++ ) {
-      double q = i + LOCATION;
-      for (int j = 0; j < ch1; j++) {
-         double p = j + LOCATION;
-          
-         double dist = sqrt((p - centerX) * (p - centerX) + (q - centerY) * (q - centerY));
-         int color1;
-         int color2;
-         int color3;
-         int numberOfColors = scanf("%d %d %d", &color1, &color2, &color3);
-         if ( numberOfColors != THREE_VALUE) {
-            exit(EXIT_STATUS3);
-         }
-         if (color1 < 0 || color1 > MAX_INTENSITY || color2 < 0 || 
-            color2 > MAX_INTENSITY || color3 < 0 || color3 > MAX_INTENSITY) {
-            exit(EXIT_STATUS3);
-         }
-         if (dist > fRadius && dist <= cornerDist) {
-            shade(color1, FRAME_RED, dist);
-            shade(color2, FRAME_GREEN, dist);
-            shade(color3, FRAME_BLUE, dist);
+      for ( int k = 0; k < n; k++ ) {
+         row[ k ] = p[ 2 * k ] << 8 | p[ 2 * k + 1 ];
+      }
+   }
+   for ( int k = 0; k < n; k++ ) {
+      if ( row[ k ] > img->maxval ) {
+         return false;
+      }
+   }
+   return true;
+}
+
+/**
+   Read one row of samples from binary input.
+   @param in input to read from.
+   @param img the image.
+   @param buf room for the bytes of the row, if they have to be copied.
+   @param row where to store the samples.
+   @return false if the input ends, or a sample is out of range.
+ */
+static bool readRowP6( Reader *in, Image const *img, unsigned char *buf, int *row ) {
+   unsigned char const *p = readBytes( in, buf, (size_t) img->width * THREE_VALUE * img->bytes );
+   return p != NULL && decodeSamples( img, p, row, img->width * THREE_VALUE );
+}
+
+/**
+   Add a color component to the row, as "%3d " would format it.
+   @param out row to add to.
+   @param value component, from 0 to MAX_MAXVAL.
+ */
+static void putComponent( Writer *out, int value ) {
+   unsigned char *p = out->data + out->len;
+   if ( value < 1000 ) {
+      p[ 0 ] = value >= 100 ? '0' + value / 100 : ' ';
+      p[ 1 ] = value >= 10 ? '0' + value / 10 % 10 : ' ';
+      p[ 2 ] = '0' + value % 10;
+      p[ 3 ] = ' ';
+      out->len += COMPONENT_WIDTH;
+      return;
+   }
+
+   int digits = value >= 10000 ? 5 : 4;
+   for ( int k = digits - 1; k >= 0; k-- ) {
+      p[ k ] = '0' + value % 10;
+      value /= 10;
+   }
+   p[ digits ] = ' ';
+   out->len += digits + 1;
+}
+
+/**
+   Add one row of samples to the output as ASCII, each formatted as "%3d ".
+   @param out buffer for the output.
+   @param img the image.
+   @param row the samples.
+ */
+static void formatRowP3( Writer *out, Image const *img, int const *row ) {
+   int n = img->width * THREE_VALUE;
+   for ( int k = 0; k < n; k++ ) {
+      putComponent( out, row[ k ] );
+   }
+   out->data[ out->len++ ] = '\n';
+}
+
+/**
+   Turn samples into binary, one or two bytes each.
+   @param img the image.
+   @param row the samples.
+   @param n number of samples.
+   @param p where to store the bytes.
+ */
+static void encodeSamples( Image const *img, int const *row, int n, unsigned char *p ) {
+   if ( img->bytes == 1 ) {
+      for ( int k = 0; k < n; k++ ) {
+         p[ k ] = row[ k ];
+      }
+   } else {
+      for ( int k = 0; k < n; k++ ) {
+         p[ 2 * k ] = row[ k ] >> 8;
+         p[ 2 * k + 1 ] = row[ k ];
+      }
+   }
+}
+
+/**
+   Add one row of samples to the output as binary.
+   @param out buffer for the output.
+   @param img the image.
+   @param row the samples.
+ */
+static void formatRowP6( Writer *out, Image const *img, int const *row ) {
+   int n = img->width * THREE_VALUE;
+   encodeSamples( img, row, n, out->data + out->len );
+   out->len += (size_t) n * img->bytes;
+}
+
+/**
+   Return true if binary samples are all in range, without decoding
+   them.  If the maximum is as big as the samples can hold, they
+   always are.
+   @param img the image.
+   @param p bytes of the samples.
+   @param n number of samples.
+   @return true if none of them are more than the maximum.
+ */
+static bool checkSamples( Image const *img, unsigned char const *p, int n ) {
+   if ( img->bytes == 1 ) {
+      for ( int k = 0; img->maxval < MAX_INTENSITY && k < n; k++ ) {
+         if ( p[ k ] > img->maxval ) {
+            return false;
+         }
+      }
+   } else {
+      for ( int k = 0; img->maxval < MAX_MAXVAL && k < n; k++ ) {
+         if ( ( p[ 2 * k ] << 8 | p[ 2 * k + 1 ] ) > img->maxval ) {
+            return false;
+         }
+      }
+   }
+   return true;
+}
+
+/**
+   Write everything in the output buffer, and empty it.
+   @param out buffer to write.
+ */
+static void flushWriter( Writer *out ) {
+   fwrite( out->data, 1, out->len, out->fp );
+   out->len = 0;
+}
+
+/**
+   Checks the file type of an image if it's starts with two characters P3
+   or P6.
+   @param in input to read the file type from.
+   @return 3 for ASCII PPM, 6 for binary, or 0 if it's neither.
+ */
+int checkFileType( Reader *in ) {
+   int c1 = peekChar( in );
+   in->pos += c1 != EOF;
+   int c2 = peekChar( in );
+   in->pos += c2 != EOF;
+   if (c1 != 'P' || (c2 != '3' && c2 != '6')) {
+      return 0;
+   }
+   return c2 - '0';
+}
+
+/**
+   Read the rest of the header, after the file type.
+   @param in input to read from.
+   @param img image to fill in, with its format already set.
+   @return false if it's not a valid header.
+ */
+static bool readHeader( Reader *in, Image *img ) {
+   if ( !readHeaderInt( in, &img->width ) || !readHeaderInt( in, &img->height ) ) {
+      return false;
+   }
+   if (img->width < 2 || img->height < 2) {
+      return false;
+   }
+   if ( !readHeaderInt( in, &img->maxval ) || img->maxval < 1 || img->maxval > MAX_MAXVAL ) {
+      return false;
+   }
+   img->bytes = img->maxval > MAX_INTENSITY ? 2 : 1;
+
+   // In binary PPM, exactly one whitespace character comes before the samples.
+   if ( img->format == 6 ) {
+      if ( !isSpace( peekChar( in ) ) ) {
+         return false;
+      }
+      in->pos++;
+   }
+   return true;
+}
+
+/**
+   Return a frame color component scaled to the image's maximum sample value.
+   @param color component, from 0 to MAX_INTENSITY.
+   @param maxval the image's maximum sample value.
+   @return the scaled component.
+ */
+static int scaleColor( int color, int maxval ) {
+   return ( color * maxval + MAX_INTENSITY / 2 ) / MAX_INTENSITY;
+}
+
+/**
+   Shade one row and add it to the output.
+   @param job the image, and how to frame it.
+   @param row samples for the row.
+   @param i index of the row.
+   @param out buffer for the output.
+ */
+static void frameRow( FrameJob const *job, int *row, int i, Writer *out ) {
+   shadeRow( job->weights, job->border, row, i );
+   if ( job->outFormat == 3 ) {
+      formatRowP3( out, &job->img, row );
+   } else {
+      formatRowP6( out, &job->img, row );
+   }
+}
+
+/**
+   Frame a strip of rows of binary input, writing binary output, a
+   tile at a time.  Tiles where nothing is under the frame, which is
+   most of them, are copied straight across.  In the rest, each row is
+   decoded, shaded and encoded again, unless it's clear of the frame too.
+   @param job the image, and how to frame it.
+   @param first index of the strip's first row.
+   @param rows number of rows in the strip.
+   @param bytes the strip's samples.
+   @param out buffer for the output.
+   @return false if a sample is out of range.
+ */
+static bool frameTiles( FrameJob const *job, int first, int rows, unsigned char const *bytes,
+                        Writer *out ) {
+   Image const *img = &job->img;
+   size_t rowBytes = (size_t) img->width * THREE_VALUE * img->bytes;
+   unsigned char *dst = out->data + out->len;
+   int samples[ TILE_WIDTH * THREE_VALUE ];
+
+   for ( int x0 = 0; x0 < img->width; x0 += TILE_WIDTH ) {
+      int x1 = img->width - x0 < TILE_WIDTH ? img->width : x0 + TILE_WIDTH;
+      int n = ( x1 - x0 ) * THREE_VALUE;
+      size_t offset = (size_t) x0 * THREE_VALUE * img->bytes;
+      size_t len = (size_t) n * img->bytes;
+
+      bool shaded = false;
+      for ( int r = 0; r < rows && !shaded; r++ ) {
+         shaded = spanShaded( job->weights, first + r, x0, x1 );
+      }
+
+      for ( int r = 0; r < rows; r++ ) {
+         unsigned char const *src = bytes + r * rowBytes + offset;
+         unsigned char *to = dst + r * rowBytes + offset;
+         if ( !shaded || !spanShaded( job->weights, first + r, x0, x1 ) ) {
+            if ( !checkSamples( img, src, n ) ) {
+               return false;
+            }
+            memcpy( to, src, len );
          } else {
-            printf("%4d%4d%4d", color1, color2, color3);
-         } 
-      }  
-      printf("\n");
-   } 
-   return EXIT_SUCCESS;
+            if ( !decodeSamples( img, src, samples, n ) ) {
+               return false;
+            }
+            shadeSpan( job->weights, job->border, samples, first + r, x0, x1 );
+            encodeSamples( img, samples, n, to );
+         }
+      }
+   }
+
+   out->len += rows * rowBytes;
+   return true;
 }
 
+/**
+   Return the most bytes a row of output can take.
+   @param img the image.
+   @return bytes for the widest row, in either format.
+ */
+static size_t rowOutputSize( Image const *img ) {
+   return (size_t) img->width * THREE_VALUE * ( COMPONENT_WIDTH + 2 ) + 1;
+}
+
+/**
+   Frame an image one row at a time, in this thread.
+   @param in input, just past the header.
+   @param job the image, and how to frame it.
+   @param outFp file to write the framed rows to.
+   @param bufs buffers to use for the rows.
+   @return 0 if it worked, or 102 if the rows are bad.
+ */
+static int frameRows( Reader *in, FrameJob const *job, FILE *outFp, Buffers *bufs ) {
+   // One row of samples, the bytes of a binary input row if they have
+   // to be copied, and room for the widest formatted output row.
+   Image const *img = &job->img;
+   size_t n = (size_t) img->width * THREE_VALUE;
+   int *row = (int *) reserve( &bufs->samples, n * sizeof( int ) );
+   unsigned char *buf = (unsigned char *) reserve( &bufs->bytes, n * img->bytes );
+   Writer out = { outFp, (unsigned char *) reserve( &bufs->out, rowOutputSize( img ) ), 0 };
+   int status = row && buf && out.data ? EXIT_SUCCESS : EXIT_STATUS2;
+
+   for (int i = 0; i < img->height && status == EXIT_SUCCESS; i++ ) {
+      bool ok = img->format == 3 ? readRowP3( in, img, row ) : readRowP6( in, img, buf, row );
+      if ( !ok ) {
+         status = EXIT_STATUS3;
+         break;
+      }
+      frameRow( job, row, i, &out );
+      flushWriter( &out );
+   }
+   return status;
+}
+
+/**
+   Frame binary input a strip of rows at a time, in this thread, with
+   each strip done a tile at a time.
+   @param in input, just past the header.
+   @param job the image, and how to frame it.
+   @param outFp file to write the framed rows to.
+   @param bufs buffers to use for the strips.
+   @return 0 if it worked, or 102 if the rows are bad.
+ */
+static int frameStrips( Reader *in, FrameJob const *job, FILE *outFp, Buffers *bufs ) {
+   Image const *img = &job->img;
+   size_t stripBytes = (size_t) img->width * THREE_VALUE * img->bytes * TILE_HEIGHT;
+   unsigned char *buf = (unsigned char *) reserve( &bufs->bytes, stripBytes );
+   Writer out = { outFp, (unsigned char *) reserve( &bufs->out, stripBytes ), 0 };
+   int status = buf && out.data ? EXIT_SUCCESS : EXIT_STATUS2;
+
+   for ( int i = 0; i < img->height && status == EXIT_SUCCESS; i += TILE_HEIGHT ) {
+      int rows = img->height - i < TILE_HEIGHT ? img->height - i : TILE_HEIGHT;
+      unsigned char const *bytes = readBytes( in, buf, rows * stripBytes / TILE_HEIGHT );
+      if ( bytes == NULL || !frameTiles( job, i, rows, bytes, &out ) ) {
+         status = EXIT_STATUS3;
+         break;
+      }
+      flushWriter( &out );
+   }
+   return status;
+}
+
+/**
+   Start function for a worker thread.  It frames bands as they're
+   read, until there are no more coming.
+   @param arg the band pool, as a void pointer.
+   @return NULL.
+ */
+static void *bandWorker( void *arg ) {
+   BandPool *pool = (BandPool *) arg;
+   FrameJob const *job = pool->job;
+   size_t n = (size_t) job->img.width * THREE_VALUE;
+   size_t rowBytes = n * job->img.bytes;
+   while ( true ) {
+      pthread_mutex_lock( &pool->lock );
+      while ( pool->next == pool->ready && !pool->finished ) {
+         pthread_cond_wait( &pool->changed, &pool->lock );
+      }
+      if ( pool->next == pool->ready ) {
+         pthread_mutex_unlock( &pool->lock );
+         return NULL;
+      }
+      Band *band = pool->bands + pool->next++ % pool->slots;
+      pthread_mutex_unlock( &pool->lock );
+
+      if ( job->tiled ) {
+         band->ok = frameTiles( job, band->first, band->rows, band->bytes, &band->out );
+      } else {
+         band->ok = true;
+         for ( int r = 0; r < band->rows && band->ok; r++ ) {
+            int *row = band->samples + r * n;
+            if ( band->bytes && !decodeSamples( &job->img, band->bytes + r * rowBytes, row, n ) ) {
+               band->ok = false;
+            } else {
+               frameRow( job, row, band->first + r, &band->out );
+            }
+         }
+      }
+
+      pthread_mutex_lock( &pool->lock );
+      band->done = true;
+      pthread_cond_broadcast( &pool->changed );
+      pthread_mutex_unlock( &pool->lock );
+   }
+}
+
+/**
+   Wait for a band to be framed, then write it out.
+   @param pool the band pool.
+   @param band the band to write.
+   @return true if the band was good.
+ */
+static bool writeBand( BandPool *pool, Band *band ) {
+   pthread_mutex_lock( &pool->lock );
+   while ( !band->done ) {
+      pthread_cond_wait( &pool->changed, &pool->lock );
+   }
+   pthread_mutex_unlock( &pool->lock );
+
+   if ( band->ok ) {
+      flushWriter( &band->out );
+   }
+   return band->ok;
+}
+
+/**
+   Frame an image in bands of rows, on a pool of worker threads.  This
+   thread reads the bands in order, the workers shade and format them,
+   and then they're written out in order, no matter what order they
+   finish in.  Binary rows are decoded by the workers, and if the input
+   is mapped they aren't even copied.
+   @param in input, just past the header.
+   @param job the image, and how to frame it.
+   @param outFp file to write the framed rows to.
+   @param threads number of worker threads.
+   @param bufs buffers to use if no threads can be started, and the
+   image is framed in this thread instead.
+   @return 0 if it worked, or 102 if the rows are bad.
+ */
+static int frameBands( Reader *in, FrameJob const *job, FILE *outFp, int threads,
+                       Buffers *bufs ) {
+   Image const *img = &job->img;
+   size_t n = (size_t) img->width * THREE_VALUE;
+   size_t rowBytes = n * img->bytes;
+   int bandRows = BAND_SAMPLES / n > 0 ? BAND_SAMPLES / n : 1;
+   if ( job->tiled ) {
+      bandRows = TILE_HEIGHT;
+   }
+   int count = ( img->height + bandRows - 1 ) / bandRows;
+
+   BandPool pool;
+   pool.job = job;
+   pool.slots = threads * BANDS_PER_THREAD;
+   pool.bands = (Band *) calloc( pool.slots, sizeof( Band ) );
+   pool.ready = pool.next = 0;
+   pool.finished = false;
+   pthread_mutex_init( &pool.lock, NULL );
+   pthread_cond_init( &pool.changed, NULL );
+
+   int status = pool.bands ? EXIT_SUCCESS : EXIT_STATUS2;
+   for ( int k = 0; k < pool.slots && status == EXIT_SUCCESS; k++ ) {
+      Band *band = pool.bands + k;
+      band->samples = (int *) malloc( job->tiled ? 1 : bandRows * n * sizeof( int ) );
+      band->buf = (unsigned char *) malloc( bandRows * rowBytes );
+      band->out.fp = outFp;
+      band->out.data = (unsigned char *) malloc( bandRows * rowOutputSize( img ) );
+      if ( band->samples == NULL || band->buf == NULL || band->out.data == NULL ) {
+         status = EXIT_STATUS2;
+      }
+   }
+
+   // Make do with however many threads can be started.  If there aren't
+   // any, nothing's been read yet, so this thread can frame the image.
+   pthread_t *workers = (pthread_t *) malloc( threads * sizeof( pthread_t ) );
+   int started = 0;
+   while ( workers && started < threads &&
+           pthread_create( workers + started, NULL, bandWorker, &pool ) == 0 ) {
+      started++;
+   }
+   bool alone = started == 0;
+
+   // Read each band into its slot, once the band that was there before
+   // it has been written.
+   int written = 0;
+   for ( int b = 0; b < count && status == EXIT_SUCCESS && !alone; b++ ) {
+      Band *band = pool.bands + b % pool.slots;
+      if ( b >= pool.slots ) {
+         if ( !writeBand( &pool, band ) ) {
+            status = EXIT_STATUS3;
+            break;
+         }
+         written++;
+      }
+
+      band->first = b * bandRows;
+      band->rows = img->height - band->first < bandRows ? img->height - band->first : bandRows;
+      band->out.len = 0;
+      band->done = false;
+      if ( img->format == 6 ) {
+         band->bytes = readBytes( in, band->buf, band->rows * rowBytes );
+         if ( band->bytes == NULL ) {
+            status = EXIT_STATUS3;
+         }
+      } else {
+         band->bytes = NULL;
+         for ( int r = 0; r < band->rows && status == EXIT_SUCCESS; r++ ) {
+            if ( !readRowP3( in, img, band->samples + r * n ) ) {
+               status = EXIT_STATUS3;
+            }
+         }
+      }
+      if ( status != EXIT_SUCCESS ) {
+         break;
+      }
+
+      pthread_mutex_lock( &pool.lock );
+      pool.ready++;
+      pthread_cond_broadcast( &pool.changed );
+      pthread_mutex_unlock( &pool.lock );
+   }
+
+   // Write the bands still in flight, up to the first bad one.
+   for ( ; written < pool.ready; written++ ) {
+      if ( !writeBand( &pool, pool.bands + written % pool.slots ) ) {
+         status = EXIT_STATUS3;
+         break;
+      }
+   }
+
+   pthread_mutex_lock( &pool.lock );
+   pool.finished = true;
+   pthread_cond_broadcast( &pool.changed );
+   pthread_mutex_unlock( &pool.lock );
+   for ( int t = 0; t < started; t++ ) {
+      pthread_join( workers[ t ], NULL );
+   }
+
+   for ( int k = 0; pool.bands && k < pool.slots; k++ ) {
+      free( pool.bands[ k ].samples );
+      free( pool.bands[ k ].buf );
+      free( pool.bands[ k ].out.data );
+   }
+   free( pool.bands );
+   free( workers );
+   pthread_mutex_destroy( &pool.lock );
+   pthread_cond_destroy( &pool.changed );
+   if ( alone && status == EXIT_SUCCESS ) {
+      return job->tiled ? frameStrips( in, job, outFp, bufs ) : frameRows( in, job, outFp, bufs );
+   }
+   return status;
+}
+
+/**
+   Print a usage message, then exit.
+ */
+static void usage() {
+   fprintf( stderr, "usage: frame [--p3|--p6] [-j N] [--tiled] [--frame <spec>]\n"
+            "             < input.ppm > output.ppm\n"
+            "       frame [--p3|--p6] [-j N] [--tiled] [--frame <spec>] [--stats]\n"
+            "             --batch <outdir> <input.ppm|dir> ...\n"
+            "spec: comma-separated shape=circle|ellipse|rrect, color=RRGGBB,\n"
+            "      falloff=linear|quad|smooth, radius=<corner radius for rrect>\n" );
+   exit( EXIT_FAILURE );
+}
+
+/**
+   Parse a frame spec, a list of key=value settings separated by commas.
+   Settings that aren't given are left as they are.
+   @param text the spec, which is changed as it's parsed.
+   @param spec where to store the settings.
+   @return false if the spec isn't valid.
+ */
+static bool parseSpec( char *text, FrameSpec *spec ) {
+   for ( char *tok = strtok( text, "," ); tok; tok = strtok( NULL, "," ) ) {
+      char *val = strchr( tok, '=' );
+      if ( val == NULL ) {
+         return false;
+      }
+      *val++ = '\0';
+
+      if ( strcmp( tok, "shape" ) == 0 ) {
+         if ( strcmp( val, "circle" ) == 0 ) {
+            spec->shape = SHAPE_CIRCLE;
+         } else if ( strcmp( val, "ellipse" ) == 0 ) {
+            spec->shape = SHAPE_ELLIPSE;
+         } else if ( strcmp( val, "rrect" ) == 0 ) {
+            spec->shape = SHAPE_RRECT;
+         } else {
+            return false;
+         }
+      } else if ( strcmp( tok, "falloff" ) == 0 ) {
+         if ( strcmp( val, "linear" ) == 0 ) {
+            spec->falloff = FALLOFF_LINEAR;
+         } else if ( strcmp( val, "quad" ) == 0 ) {
+            spec->falloff = FALLOFF_QUAD;
+         } else if ( strcmp( val, "smooth" ) == 0 ) {
+            spec->falloff = FALLOFF_SMOOTH;
+         } else {
+            return false;
+         }
+      } else if ( strcmp( tok, "color" ) == 0 ) {
+         // Six hex digits, with or without a # in front.
+         val += *val == '#';
+         char *end;
+         long rgb = strtol( val, &end, 16 );
+         if ( end - val != 6 || *end != '\0' ) {
+            return false;
+         }
+         spec->color[ 0 ] = rgb >> 16 & MAX_INTENSITY;
+         spec->color[ 1 ] = rgb >> 8 & MAX_INTENSITY;
+         spec->color[ 2 ] = rgb & MAX_INTENSITY;
+      } else if ( strcmp( tok, "radius" ) == 0 ) {
+         char *end;
+         long radius = strtol( val, &end, 10 );
+         if ( end == val || *end != '\0' || radius < 0 || radius > INT_MAX ) {
+            return false;
+         }
+         spec->radius = radius;
+      } else {
+         return false;
+      }
+   }
+   return true;
+}
+
+/**
+   Add the frame to one image.
+   @param fp file to read the image from.
+   @param outFp file to write the framed image to.
+   @param opts options from the command line.
+   @param threads number of threads to frame the image with.
+   @param bufs buffers to use if it's framed in this thread.
+   @param img where to store the size and format of the image.
+   @return 0 if it worked, or the exit status for what went wrong,
+   100 for a bad file type, 101 for a bad header and 102 for bad pixels.
+ */
+static int frameImage( FILE *fp, FILE *outFp, Options const *opts, int threads, Buffers *bufs,
+                       Image *img ) {
+   Reader in;
+   openReader( &in, fp );
+   img->format = checkFileType( &in );
+   if ( img->format == 0 ) {
+      closeReader( &in );
+      return EXIT_STATUS1;
+   }
+   if ( !readHeader( &in, img ) ) {
+      closeReader( &in );
+      return EXIT_STATUS2;
+   }
+   int outFormat = opts->outFormat ? opts->outFormat : img->format;
+   fprintf( outFp, "P%d\n%d %d\n%d\n", outFormat, img->width, img->height, img->maxval );
+
+   FrameJob job;
+   job.img = *img;
+   job.outFormat = outFormat;
+   job.weights = getWeights( &opts->spec, img->width, img->height );
+   for ( int c = 0; c < RING_CHANNELS; c++ ) {
+      job.border[ c ] = scaleColor( opts->spec.color[ c ], img->maxval );
+   }
 
+   // Tiles only help when the samples can be copied straight across.
+   job.tiled = opts->tiled && img->format == 6 && outFormat == 6;
+
+   int status = EXIT_STATUS2;
+   if ( job.weights && threads > 1 ) {
+      status = frameBands( &in, &job, outFp, threads, bufs );
+   } else if ( job.weights && job.tiled ) {
+      status = frameStrips( &in, &job, outFp, bufs );
+   } else if ( job.weights ) {
+      status = frameRows( &in, &job, outFp, bufs );
+   }
+   if ( job.weights ) {
+      releaseWeights( job.weights );
+   }
+   closeReader( &in );
+   return status;
+}
+
+/**
+   Add a file to a list of names, making room for it if needed.
+   @param list the list.
+   @param count number of names in the list.
+   @param cap capacity of the list.
+   @param name name to add, which the list takes over.
+ */
+static void addName( char ***list, int *count, int *cap, char *name ) {
+   if ( *count >= *cap ) {
+      *cap = *cap ? *cap * 2 : 16;
+      *list = (char **) realloc( *list, *cap * sizeof( char * ) );
+   }
+   ( *list )[ ( *count )++ ] = name;
+}
+
+/**
+   Compare two file names, for sorting with qsort().
+   @param a pointer to the first name.
+   @param b pointer to the second name.
+   @return negative, zero or positive, like strcmp().
+ */
+static int compareNames( void const *a, void const *b ) {
+   return strcmp( *(char *const *) a, *(char *const *) b );
+}
+
+/**
+   Make the list of images to frame from the command line.  Each
+   directory stands for the regular files in it, in order by name,
+   skipping hidden ones.  Anything else is framed as it is, so a file
+   that can't be opened is reported like any other bad image.
+   @param args files and directories from the command line.
+   @param argCount number of them.
+   @param count where to store the number of images.
+   @return names of the images.  The caller frees each name, then
+   the list.
+ */
+static char **listImages( char *args[], int argCount, int *count ) {
+   char **list = NULL;
+   int cap = 0;
+   *count = 0;
+   for ( int a = 0; a < argCount; a++ ) {
+      struct stat st;
+      DIR *dir = stat( args[ a ], &st ) == 0 && S_ISDIR( st.st_mode ) ? opendir( args[ a ] ) : NULL;
+      if ( dir == NULL ) {
+         addName( &list, count, &cap, strdup( args[ a ] ) );
+         continue;
+      }
+
+      int first = *count;
+      for ( struct dirent *ent = readdir( dir ); ent; ent = readdir( dir ) ) {
+         if ( ent->d_name[ 0 ] == '.' ) {
+            continue;
+         }
+         char *name = (char *) malloc( strlen( args[ a ] ) + strlen( ent->d_name ) + 2 );
+         sprintf( name, "%s/%s", args[ a ], ent->d_name );
+         if ( stat( name, &st ) == 0 && S_ISREG( st.st_mode ) ) {
+            addName( &list, count, &cap, name );
+         } else {
+            free( name );
+         }
+      }
+      closedir( dir );
+      qsort( list + first, *count - first, sizeof( char * ), compareNames );
+   }
+   return list;
+}
+
+/**
+   Frame one image in a batch, from its file to its output file.
+   @param item the image.
+   @param opts options from the command line.
+   @param bufs buffers for framing it.
+ */
+static void frameItem( BatchItem *item, Options const *opts, Buffers *bufs ) {
+   // The output only replaces the file that's there once it's all
+   // written, so nothing is lost if the image can't be framed.
+   double start = now();
+   item->status = EXIT_FAILURE;
+   FILE *fp = fopen( item->path, "rb" );
+   FILE *outFp = fp ? fopen( item->tmpName, "wb" ) : NULL;
+   if ( outFp ) {
+      item->status = frameImage( fp, outFp, opts, 1, bufs, &item->img );
+      if ( fclose( outFp ) != 0 && item->status == EXIT_SUCCESS ) {
+         item->status = EXIT_FAILURE;
+      }
+      if ( item->status == EXIT_SUCCESS && rename( item->tmpName, item->outName ) != 0 ) {
+         item->status = EXIT_FAILURE;
+      }
+      if ( item->status != EXIT_SUCCESS ) {
+         remove( item->tmpName );
+      }
+   }
+   if ( fp ) {
+      fclose( fp );
+   }
+   item->seconds = now() - start;
+}
+
+/** A file's identity, for telling whether two names are the same file. */
+typedef struct {
+   dev_t dev;
+   ino_t ino;
+
+   /** Name the file was found under. */
+   char const *name;
+} FileId;
+
+/**
+   Compare two file identities, for sorting with qsort() and
+   searching with bsearch().
+   @param a pointer to the first identity.
+   @param b pointer to the second identity.
+   @return negative, zero or positive, for before, the same or after.
+ */
+static int compareIds( void const *a, void const *b ) {
+   FileId const *x = (FileId const *) a;
+   FileId const *y = (FileId const *) b;
+   if ( x->dev != y->dev ) {
+      return x->dev < y->dev ? -1 : 1;
+   }
+   return x->ino < y->ino ? -1 : x->ino > y->ino;
+}
+
+/**
+   Compare the output names of two images in a batch, for sorting with
+   qsort().
+   @param a pointer to a pointer to the first image.
+   @param b pointer to a pointer to the second image.
+   @return negative, zero or positive, like strcmp().
+ */
+static int compareOutputs( void const *a, void const *b ) {
+   return strcmp( ( *(BatchItem const *const *) a )->outName,
+                  ( *(BatchItem const *const *) b )->outName );
+}
+
+/**
+   Make sure each image in a batch goes to a different output file,
+   and that framing it can't overwrite any of its own inputs, as it
+   would if the output directory is one of the input directories.
+   Inputs with the same name, and outputs that are the same file as an
+   input, are reported.
+   @param items images in the batch.
+   @param count number of images.
+   @return true if the outputs are all different, and none of them is
+   an input.
+ */
+static bool checkOutputs( BatchItem const *items, int count ) {
+   // Sorting by output name puts any that are the same next to each other.
+   BatchItem const **sorted = (BatchItem const **) malloc( ( count ? count : 1 ) *
+                                                           sizeof( BatchItem * ) );
+   for ( int f = 0; f < count; f++ ) {
+      sorted[ f ] = items + f;
+   }
+   qsort( sorted, count, sizeof( BatchItem * ), compareOutputs );
+   bool ok = true;
+   for ( int f = 1; f < count; f++ ) {
+      if ( strcmp( sorted[ f - 1 ]->outName, sorted[ f ]->outName ) == 0 ) {
+         fprintf( stderr, "frame: %s and %s would both be framed to %s\n", sorted[ f - 1 ]->path,
+                  sorted[ f ]->path, sorted[ f ]->outName );
+         ok = false;
+      }
+   }
+   free( sorted );
+
+   FileId *inputs = (FileId *) malloc( ( count ? count : 1 ) * sizeof( FileId ) );
+   int n = 0;
+   struct stat st;
+   for ( int f = 0; f < count; f++ ) {
+      if ( stat( items[ f ].path, &st ) == 0 ) {
+         inputs[ n ].dev = st.st_dev;
+         inputs[ n ].ino = st.st_ino;
+         inputs[ n ].name = items[ f ].path;
+         n++;
+      }
+   }
+   qsort( inputs, n, sizeof( FileId ), compareIds );
+
+   for ( int f = 0; f < count; f++ ) {
+      if ( stat( items[ f ].outName, &st ) == 0 ) {
+         FileId key = { st.st_dev, st.st_ino, NULL };
+         FileId const *same = (FileId const *) bsearch( &key, inputs, n, sizeof( FileId ),
+                                                        compareIds );
+         if ( same ) {
+            fprintf( stderr, "frame: output %s would overwrite input %s\n", items[ f ].outName,
+                     same->name );
+            ok = false;
+         }
+      }
+   }
+   free( inputs );
+   return ok;
+}
+
+/**
+   Start function for a worker thread in a batch.  It frames one image
+   after another, with its own buffers, until they've all been taken.
+   @param arg the batch, as a void pointer.
+   @return NULL.
+ */
+static void *batchWorker( void *arg ) {
+   Batch *batch = (Batch *) arg;
+   Buffers bufs = { { NULL, 0 }, { NULL, 0 }, { NULL, 0 } };
+   while ( true ) {
+      pthread_mutex_lock( &batch->lock );
+      int f = batch->next < batch->count ? batch->next++ : -1;
+      pthread_mutex_unlock( &batch->lock );
+      if ( f < 0 ) {
+         break;
+      }
+
+      frameItem( batch->items + f, batch->opts, &bufs );
+
+      pthread_mutex_lock( &batch->lock );
+      batch->items[ f ].done = true;
+      pthread_cond_broadcast( &batch->finished );
+      pthread_mutex_unlock( &batch->lock );
+   }
+   freeBuffers( &bufs );
+   return NULL;
+}
+
+/**
+   Frame each of a list of images, writing each one to a file with the
+   same name in the output directory.  The images are framed by a pool
+   of threads, one image per thread at a time.  A file that can't be
+   framed is reported, and the rest are still done.  If two inputs have
+   the same name, or any output would be one of the inputs, nothing is
+   framed at all.  With --stats, the time
+   for each image that worked and the throughput for the whole batch
+   are reported too, in the order the images were given.
+   @param outDir directory for the framed images.
+   @param files names of the images.
+   @param count number of images.
+   @param opts options from the command line.
+   @return 0 if they all worked, 1 if the outputs clash with each
+   other or the inputs, or the exit status for the first one that
+   didn't work.
+ */
+static int frameBatch( char const *outDir, char *files[], int count, Options const *opts ) {
+   double start = now();
+   Batch batch;
+   batch.items = (BatchItem *) calloc( count ? count : 1, sizeof( BatchItem ) );
+   batch.count = count;
+   batch.next = 0;
+   batch.opts = opts;
+   pthread_mutex_init( &batch.lock, NULL );
+   pthread_cond_init( &batch.finished, NULL );
+   for ( int f = 0; f < count; f++ ) {
+      // basename() can change its argument, so give it a copy.
+      char *copy = strdup( files[ f ] );
+      batch.items[ f ].path = files[ f ];
+      batch.items[ f ].outName = (char *) malloc( strlen( outDir ) + strlen( files[ f ] ) + 2 );
+      sprintf( batch.items[ f ].outName, "%s/%s", outDir, basename( copy ) );
+      batch.items[ f ].tmpName = (char *) malloc( strlen( batch.items[ f ].outName ) + 32 );
+      sprintf( batch.items[ f ].tmpName, "%s.%ld.tmp", batch.items[ f ].outName,
+               (long) getpid() );
+      free( copy );
+   }
+
+   // Nothing is framed if the batch would write over its own inputs, or
+   // write two images to the same place.
+   int result = EXIT_SUCCESS;
+   if ( !checkOutputs( batch.items, count ) ) {
+      batch.count = 0;
+      result = EXIT_FAILURE;
+   }
+
+   // There's no use in more threads than images.
+   int threads = opts->threads < batch.count ? opts->threads : batch.count;
+   if ( threads < 1 ) {
+      threads = 1;
+   }
+   // Make do with however many threads can be started, or if there
+   // aren't any, frame the images in this thread.
+   pthread_t *workers = (pthread_t *) malloc( threads * sizeof( pthread_t ) );
+   int started = 0;
+   while ( workers && started < threads &&
+           pthread_create( workers + started, NULL, batchWorker, &batch ) == 0 ) {
+      started++;
+   }
+   if ( started == 0 ) {
+      batchWorker( &batch );
+   }
+
+   // Report on each image as it finishes, in order.
+   int framed = 0;
+   double pixels = 0;
+   for ( int f = 0; f < batch.count; f++ ) {
+      BatchItem *item = batch.items + f;
+      pthread_mutex_lock( &batch.lock );
+      while ( !item->done ) {
+         pthread_cond_wait( &batch.finished, &batch.lock );
+      }
+      pthread_mutex_unlock( &batch.lock );
+
+      if ( item->status != EXIT_SUCCESS ) {
+         fprintf( stderr, "frame: can't frame %s (status %d)\n", item->path, item->status );
+         if ( result == EXIT_SUCCESS ) {
+            result = item->status;
+         }
+      } else if ( opts->stats ) {
+         double mp = (double) item->img.width * item->img.height / 1e6;
+         framed++;
+         pixels += mp;
+         fprintf( stderr, "frame: %s %dx%d in %.6f s, %.2f MP/s\n", item->path,
+                  item->img.width, item->img.height, item->seconds,
+                  item->seconds > 0 ? mp / item->seconds : 0.0 );
+      }
+   }
+
+   for ( int t = 0; t < started; t++ ) {
+      pthread_join( workers[ t ], NULL );
+   }
+   if ( opts->stats ) {
+      double seconds = now() - start;
+      fprintf( stderr, "frame: %d images, %.2f MP in %.6f s on %d threads, %.2f MP/s\n", framed,
+               pixels, seconds, started ? started : 1, seconds > 0 ? pixels / seconds : 0.0 );
+   }
+
+   for ( int f = 0; f < count; f++ ) {
+      free( batch.items[ f ].outName );
+      free( batch.items[ f ].tmpName );
+   }
+   free( batch.items );
+   free( workers );
+   pthread_mutex_destroy( &batch.lock );
+   pthread_cond_destroy( &batch.finished );
+   return result;
+}
+
+/**
+   Starting point of the program, which calls it's helper functions and adds the
+   frame over the image.  The output is in the same format as the
+   input, unless --p3 or --p6 asks for ASCII or binary.  With -j, each
+   image is split into bands of rows that are framed by N threads, or
+   in a batch, N images are framed at once.
+   With --tiled, binary images are framed a tile at a time, and
+   --frame picks the frame's shape, color and falloff.
+   @param argc number of command-line arguments.
+   @param argv the command-line arguments.
+ */
+int main( int argc, char *argv[] ) {
+   Options opts = { 0, 1, false, false,
+                    { SHAPE_CIRCLE, FALLOFF_LINEAR, -1, { FRAME_RED, FRAME_GREEN, FRAME_BLUE } } };
+   char const *outDir = NULL;
+   int a = 1;
+   for ( ; a < argc && argv[ a ][ 0 ] == '-'; a++ ) {
+      if ( strcmp( argv[ a ], "--p3" ) == 0 ) {
+         opts.outFormat = 3;
+      } else if ( strcmp( argv[ a ], "--p6" ) == 0 ) {
+         opts.outFormat = 6;
+      } else if ( strcmp( argv[ a ], "--tiled" ) == 0 ) {
+         opts.tiled = true;
+      } else if ( strcmp( argv[ a ], "--stats" ) == 0 ) {
+         opts.stats = true;
+      } else if ( strcmp( argv[ a ], "--frame" ) == 0 && a + 1 < argc ) {
+         if ( !parseSpec( argv[ ++a ], &opts.spec ) ) {
+            usage();
+         }
+      } else if ( strcmp( argv[ a ], "--batch" ) == 0 && a + 1 < argc ) {
+         outDir = argv[ ++a ];
+      } else if ( strcmp( argv[ a ], "-j" ) == 0 && a + 1 < argc ) {
+         opts.threads = atoi( argv[ ++a ] );
+         if ( opts.threads < 1 ) {
+            usage();
+         }
+      } else {
+         usage();
+      }
+   }
+
+   if ( outDir ) {
+      int count;
+      char **files = listImages( argv + a, argc - a, &count );
+      int status = frameBatch( outDir, files, count, &opts );
+      for ( int f = 0; f < count; f++ ) {
+         free( files[ f ] );
+      }
+      free( files );
+      return status;
+   }
+   if ( a != argc ) {
+      usage();
+   }
+
+   Buffers bufs = { { NULL, 0 }, { NULL, 0 }, { NULL, 0 } };
+   Image img;
+   int status = frameImage( stdin, stdout, &opts, opts.threads, &bufs, &img );
+   freeBuffers( &bufs );
+   return status;
+}
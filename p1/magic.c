@@ -2,63 +2,327 @@
   @file magic.c
   @author Prem Subedi (pksubedi)
   This program highlights the integer from the text file into red color,
-  skipping the integers that are the part of the identifiers.
+  skipping the integers that are the part of the identifiers.  The input
+  is read in large blocks, and each byte is classified with a lookup
+  table.  The text between the colors is copied to an output buffer all
+  at once, and the buffer is written out whenever it fills up.  Text
+  and identifiers are scanned 16 or 32 bytes at a time with SSE2 or
+  AVX2, when the processor has them.
 */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <immintrin.h>
+#define MAGIC_X86 1
+#endif
+
 #define RED  "\033[31m"    /* Red color */
 #define DEFAULT "\033[0m"  /* Default color */
-#define EXIT_SUCCESS 0
+
+/** Size of the blocks the input is read in, and of the output buffer. */
+#define BLOCK_SIZE 65536
+
+/** Class bit for a digit. */
+#define CLASS_DIGIT 1
+
+/** Class bit for a character that can start an identifier, a letter or
+    an underscore. */
+#define CLASS_ALPHA 2
+
+/** Class of each byte, 0 for anything that isn't part of a number or
+    an identifier. */
+static unsigned char charClass[ 256 ];
+
+/** Signature of a scanner, which returns the first byte from p on that
+    is part of a number or identifier, or if word is true, the first one
+    that isn't, or end if there's no such byte. */
+typedef char const *(*Scanner)(char const *p, char const *end, bool word);
+
+/** Scanner picked for this processor. */
+static Scanner scanner;
+
+/** What kind of run the last block ended in, so it can carry on in the
+    next one. */
+typedef enum { RUN_OTHER, RUN_IDENT, RUN_NUMBER } RunType;
+
+/** Buffered output. */
+typedef struct {
+  /** Characters waiting to be written. */
+  char data[ BLOCK_SIZE ];
+
+  /** Number of characters in data. */
+  size_t len;
+
+  /** True if a write failed. */
+  bool error;
+} Output;
+
+/**
+  Fill in the class of each byte.
+ */
+void initClasses()
+{
+  for (int ch = '0'; ch <= '9'; ch++)
+    charClass[ch] = CLASS_DIGIT;
+  for (int ch = 'A'; ch <= 'Z'; ch++)
+    charClass[ch] = CLASS_ALPHA;
+  for (int ch = 'a'; ch <= 'z'; ch++)
+    charClass[ch] = CLASS_ALPHA;
+  charClass['_'] = CLASS_ALPHA;
+}
+
+/**
+  Write out everything in the output buffer.
+  @param out the output.
+ */
+void flushOutput(Output *out)
+{
+  if (out->len > 0 && fwrite(out->data, 1, out->len, stdout) != out->len)
+    out->error = true;
+  out->len = 0;
+}
 
 /**
-  Highlights all the free integers (that are not the part of identifiers) with red color.
+  Add a run of characters to the output.  Runs too big for the buffer
+  are written straight out.
+  @param out the output.
+  @param text start of the run.
+  @param len number of characters in the run.
  */
-void highlightNumber() 
+void append(Output *out, char const *text, size_t len)
 {
-  int ch = getchar();
-  printf(RED); 
-  while (ch >= '0' && ch <= '9') {
-   putchar(ch);
-   ch = getchar();
+  if (out->len + len > BLOCK_SIZE) {
+    flushOutput(out);
+    if (len >= BLOCK_SIZE) {
+      if (fwrite(text, 1, len, stdout) != len)
+        out->error = true;
+      return;
+    }
   }
-  ungetc(ch, stdin);
-  printf(DEFAULT); 
+  memcpy(out->data + out->len, text, len);
+  out->len += len;
+}
+
+/**
+  Finds the end of a number, so it can be highlighted.
+  @param p start of the number, or the rest of it.
+  @param end end of the block.
+  @return the character after the number, or end.
+ */
+char const *highlightNumber(char const *p, char const *end)
+{
+  while (p < end && charClass[(unsigned char) *p] == CLASS_DIGIT)
+    p++;
+  return p;
+}
+
+/**
+  Scan for the end of a run of text or of word characters, one byte at a time.
+  @param p start of the run.
+  @param end end of the block.
+  @param word true if it's a run of word characters.
+  @return the character after the run, or end.
+ */
+char const *scanScalar(char const *p, char const *end, bool word)
+{
+  while (p < end && (charClass[(unsigned char) *p] != 0) == word)
+    p++;
+  return p;
+}
+
+#ifdef MAGIC_X86
+
+/**
+  Mark the bytes in a vector that fall in a range.
+  @param v the bytes.
+  @param lo first byte in the range.
+  @param n number of bytes in the range.
+  @return 0xff for each byte in the range, and 0 for the others.
+ */
+__attribute__(( target( "sse2" ) ))
+static __m128i inRangeSSE2(__m128i v, char lo, char n)
+{
+  __m128i t = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+  return _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(n - 1)), t);
+}
+
+/**
+  Scan for the end of a run of text or of word characters, 16 bytes at
+  a time with SSE2.  Letters are folded to lower case by setting bit 5,
+  which can't make anything else a lower case letter.
+  @param p start of the run.
+  @param end end of the block.
+  @param word true if it's a run of word characters.
+  @return the character after the run, or end.
+ */
+__attribute__(( target( "sse2" ) ))
+static char const *scanSSE2(char const *p, char const *end, bool word)
+{
+  unsigned flip = word ? 0xffff : 0;
+  for (; end - p >= 16; p += 16) {
+    __m128i v = _mm_loadu_si128((__m128i const *) p);
+    __m128i hit = _mm_or_si128(inRangeSSE2(v, '0', 10),
+                               inRangeSSE2(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 26));
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+    unsigned mask = _mm_movemask_epi8(hit) ^ flip;
+    if (mask)
+      return p + __builtin_ctz(mask);
+  }
+  return scanScalar(p, end, word);
+}
+
+/**
+  Mark the bytes in a vector that fall in a range.
+  @param v the bytes.
+  @param lo first byte in the range.
+  @param n number of bytes in the range.
+  @return 0xff for each byte in the range, and 0 for the others.
+ */
+__attribute__(( target( "avx2" ) ))
+static __m256i inRangeAVX2(__m256i v, char lo, char n)
+{
+  __m256i t = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+  return _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(n - 1)), t);
+}
+
+/**
+  Scan for the end of a run of text or of word characters, 32 bytes at
+  a time with AVX2, the same way as scanSSE2().
+  @param p start of the run.
+  @param end end of the block.
+  @param word true if it's a run of word characters.
+  @return the character after the run, or end.
+ */
+__attribute__(( target( "avx2" ) ))
+static char const *scanAVX2(char const *p, char const *end, bool word)
+{
+  unsigned flip = word ? 0xffffffff : 0;
+  for (; end - p >= 32; p += 32) {
+    __m256i v = _mm256_loadu_si256((__m256i const *) p);
+    __m256i hit = _mm256_or_si256(inRangeAVX2(v, '0', 10),
+                                  inRangeAVX2(_mm256_or_si256(v, _mm256_set1_epi8(0x20)),
+                                              'a', 26));
+    hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+    unsigned mask = (unsigned) _mm256_movemask_epi8(hit) ^ flip;
+    if (mask)
+      return p + __builtin_ctz(mask);
+  }
+  return scanSSE2(p, end, word);
+}
+
+#endif
+
+/**
+  Pick the scanner to use, the fastest one the processor supports, or
+  the one named by MAGIC_KERNEL, "avx2", "sse2" or "scalar".
+ */
+void pickScanner()
+{
+  char const *want = getenv("MAGIC_KERNEL");
+  scanner = scanScalar;
+  if (want && strcmp(want, "scalar") == 0)
+    return;
+
+#ifdef MAGIC_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && (!want || strcmp(want, "avx2") == 0))
+    scanner = scanAVX2;
+  else if (__builtin_cpu_supports("sse2"))
+    scanner = scanSSE2;
+#endif
 }
 
 /**
   Skips the identifier from being get colored.
+  @param p start of the identifier, or the rest of it.
+  @param end end of the block.
+  @return the character after the identifier, or end.
+ */
+char const *skipIdentifier(char const *p, char const *end)
+{
+  return scanner(p, end, true);
+}
+
+/**
+  Skips the text up to the next number or identifier.  Most of the
+  input is usually plain text, so this is where the vector scanners
+  help the most.
+  @param p start of the text.
+  @param end end of the block.
+  @return the start of the next number or identifier, or end.
  */
-void skipIdentifier()
+char const *skipText(char const *p, char const *end)
 {
-  int ch = getchar();
-  while ((ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z') || 
-    ch == '_' || (ch >= '0' && ch <= '9')) {
-  putchar(ch);
-  ch = getchar();
+  return scanner(p, end, false);
+}
+
+/**
+  Copy a block of input to the output, with the colors turned on and
+  off around each number.  Everything else goes out just as it is, so
+  it's copied in one piece from one number to the next.
+  @param out the output.
+  @param p start of the block.
+  @param end end of the block.
+  @param run kind of run the last block ended in, updated for this one.
+ */
+void highlightBlock(Output *out, char const *p, char const *end, RunType *run)
+{
+  char const *start = p;
+  while (p < end) {
+    if (*run == RUN_NUMBER) {
+      p = highlightNumber(p, end);
+      if (p < end) {
+        append(out, start, p - start);
+        append(out, DEFAULT, sizeof(DEFAULT) - 1);
+        start = p;
+        *run = RUN_OTHER;
+      }
+    } else if (*run == RUN_IDENT) {
+      p = skipIdentifier(p, end);
+      if (p < end)
+        *run = RUN_OTHER;
+    } else {
+      p = skipText(p, end);
+      if (p < end && charClass[(unsigned char) *p] == CLASS_DIGIT) {
+        append(out, start, p - start);
+        append(out, RED, sizeof(RED) - 1);
+        start = p;
+        *run = RUN_NUMBER;
+      } else if (p < end) {
+        *run = RUN_IDENT;
+      }
+    }
   }
-  ungetc(ch, stdin);
+  append(out, start, end - start);
 }
 
 /**
-  Starting point for the program, which calls two other helper functions
+  Starting point for the program, which calls the other helper functions
   to highlight integers involved in the input text file.
  */
 int main()
 {
-  int ch;
-  // Read all the characters from standard input.
-  while ( (ch = getchar() ) != EOF)
-  {
-    if ((ch >= 'A' && ch <= 'Z')|| (ch >= 'a' && ch <= 'z') || ch == '_') {
-      ungetc(ch, stdin);
-      skipIdentifier();
-    } else if (ch >= '0' && ch <= '9') {
-      ungetc(ch, stdin);
-      highlightNumber();
-    }
-    else {
-    putchar(ch);
-    }
-  } 
+  static char block[ BLOCK_SIZE ];
+  static Output out;
+  initClasses();
+  pickScanner();
+
+  // Read all the characters from standard input, a block at a time.
+  RunType run = RUN_OTHER;
+  size_t n;
+  while ((n = fread(block, 1, BLOCK_SIZE, stdin)) > 0) {
+    highlightBlock(&out, block, block + n, &run);
+  }
+
+  // A number at the very end still gets its color turned off.
+  if (run == RUN_NUMBER)
+    append(&out, DEFAULT, sizeof(DEFAULT) - 1);
+  flushOutput(&out);
+  if (out.error || ferror(stdin))
+    return EXIT_FAILURE;
   return EXIT_SUCCESS;
 }
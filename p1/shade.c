@@ -0,0 +1,664 @@
+/**
+   @file shade.c
+   @author Prem Subedi
+   This component shades the pixels under the frame.  The weights come
+   from a table that's built once for each image size and frame, with
+   a separate loop for each shape, so the shape never has to be
+   checked pixel by pixel.  Shading only reads the table, and works
+   the same for every shape.  The SIMD versions of the blend work
+   along the run of shaded pixels at each end of a row, two or four
+   pixels at a time, with the weights spread out to match the samples.
+   Rounding is done by truncating and comparing the fraction against a
+   half, which matches round() since shaded values are never negative,
+   so every version gives exactly the same samples.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "shade.h"
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <immintrin.h>
+#define SHADE_X86 1
+#endif
+
+/** Offset from a pixel's index to its middle. */
+#define PIXEL_CENTER 0.5
+
+/** Number of weight tables kept for images of different sizes. */
+#define WEIGHT_CACHE 8
+
+/** Signature of a row kernel, which shades the pixels from index from
+    up to index to in a row, given a pointer to the first of them. */
+typedef void (*RowKernel)( WeightTable const *table, int const *border, int *px, int i,
+                           int from, int to );
+
+/** The shaded pixels in part of a row, the ones in from the left edge
+    up to leftEnd and the ones from rightStart out to the right edge.
+    Pixels at the right are mirror images of ones at the left, so their
+    weight for pixel c is w[ last - c ]. */
+typedef struct {
+   /** Weights for the row. */
+   double const *w;
+
+   /** Index of the last pixel in the row. */
+   int last;
+
+   /** End of the shaded pixels at the left, and start of the ones at
+       the right, both limited to the part of the row being shaded. */
+   int leftEnd;
+   int rightStart;
+} Span;
+
+/** Kernel picked for this processor. */
+static RowKernel kernel;
+
+/** Makes sure the kernel is only picked once, even if the first rows
+    are shaded on several threads at once. */
+static pthread_once_t kernelOnce = PTHREAD_ONCE_INIT;
+
+/** Name of the kernel. */
+static char const *kernelName;
+
+/** Where the frame goes, worked out from the image size and the frame
+    spec.  Each shape measures how far out a pixel is in its own way.
+    A pixel is shaded if that's more than inner, with a weight that
+    goes from 0 there up to 1 at outer, the pixel in the corner. */
+typedef struct {
+   /** Center of the image. */
+   double centerX;
+   double centerY;
+
+   /** Measure of the inside edge of the frame, and of the corner. */
+   double inner;
+   double outer;
+
+   /** For an ellipse, how much to scale distances across and down by.
+       For a rounded rectangle, how far the straight part of the sides
+       reaches from the center. */
+   double sx;
+   double sy;
+} Geometry;
+
+/** Signature of a loop that works out the weights for a row. */
+typedef int (*RowWeigher)( Geometry const *geo, double y, int cols, double *w );
+
+/** Weight tables for the last few image sizes. */
+static WeightTable *cache[ WEIGHT_CACHE ];
+
+/** Slot in the cache to replace next. */
+static int nextSlot;
+
+/** Lock for the cache, and for the reference counts of the tables. */
+static pthread_mutex_t cacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+   Return a squared radius that's never more than the real one.  A
+   pixel whose squared distance is no more than this is certainly
+   inside the frame, and anything else is checked with its actual
+   distance, the same way the original loop did.
+   @param radius the frame's radius.
+   @return a lower bound on the squared radius.
+ */
+static double innerBound( double radius ) {
+   return nextafter( radius * radius, 0 );
+}
+
+/**
+   Free the memory for a weight table.
+   @param table table to free.
+ */
+static void freeWeights( WeightTable *table ) {
+   if ( table ) {
+      free( table->count );
+      free( table->start );
+      free( table->w );
+      free( table );
+   }
+}
+
+/**
+   Work out where the frame goes in an image.
+   @param spec shape of the frame.
+   @param width width of the image.
+   @param height height of the image.
+   @param geo where to store the frame's geometry.
+ */
+static void findGeometry( FrameSpec const *spec, int width, int height, Geometry *geo ) {
+   geo->centerX = width / 2.0;
+   geo->centerY = height / 2.0;
+   double cx = PIXEL_CENTER - geo->centerX;
+   double cy = PIXEL_CENTER - geo->centerY;
+
+   // Half the size of the image, out to the middle of the edge pixels.
+   double hx = ( width - 1 ) / 2.0;
+   double hy = ( height - 1 ) / 2.0;
+   double r = hx <= hy ? hx : hy;
+
+   if ( spec->shape == SHAPE_CIRCLE ) {
+      // The frame's radius is half the shorter side, less half a pixel.
+      geo->inner = r;
+      geo->outer = sqrt( cx * cx + cy * cy );
+   } else if ( spec->shape == SHAPE_ELLIPSE ) {
+      // Distances are scaled so the ellipse touches all four edges.
+      geo->sx = 1 / hx;
+      geo->sy = 1 / hy;
+      geo->inner = 1;
+      geo->outer = sqrt( ( cx * geo->sx ) * ( cx * geo->sx ) + ( cy * geo->sy ) * ( cy * geo->sy ) );
+   } else {
+      // The straight part of each side stops the corner radius short
+      // of the corner.
+      if ( spec->radius >= 0 && spec->radius < r ) {
+         r = spec->radius;
+      } else if ( spec->radius < 0 ) {
+         r = r / 2;
+      }
+      geo->sx = hx - r;
+      geo->sy = hy - r;
+      double qx = fabs( cx ) - geo->sx;
+      double qy = fabs( cy ) - geo->sy;
+      geo->inner = r;
+      geo->outer = sqrt( qx * qx + qy * qy );
+   }
+}
+
+/**
+   Work out the weights for a row of a circular frame.
+   @param geo where the frame goes.
+   @param y vertical position of the row.
+   @param cols number of pixels in the left half of the row.
+   @param w where to store the weights.
+   @return number of shaded pixels, in from the left edge.
+ */
+static int weighCircle( Geometry const *geo, double y, int cols, double *w ) {
+   double dy2 = ( y - geo->centerY ) * ( y - geo->centerY );
+   double r2 = innerBound( geo->inner );
+   int j = 0;
+   for ( ; j < cols; j++ ) {
+      double dx = j + PIXEL_CENTER - geo->centerX;
+      double d2 = dx * dx + dy2;
+      if ( d2 <= r2 ) {
+         break;
+      }
+      double dist = sqrt( d2 );
+      if ( !( dist > geo->inner && dist <= geo->outer ) ) {
+         break;
+      }
+      w[ j ] = ( dist - geo->inner ) / ( geo->outer - geo->inner );
+   }
+   return j;
+}
+
+/**
+   Work out the weights for a row of an elliptical frame.
+   @param geo where the frame goes.
+   @param y vertical position of the row.
+   @param cols number of pixels in the left half of the row.
+   @param w where to store the weights.
+   @return number of shaded pixels, in from the left edge.
+ */
+static int weighEllipse( Geometry const *geo, double y, int cols, double *w ) {
+   double ny = ( y - geo->centerY ) * geo->sy;
+   double ny2 = ny * ny;
+   int j = 0;
+   for ( ; j < cols; j++ ) {
+      double nx = ( j + PIXEL_CENTER - geo->centerX ) * geo->sx;
+      double dist = sqrt( nx * nx + ny2 );
+      if ( !( dist > geo->inner && dist <= geo->outer ) ) {
+         break;
+      }
+      w[ j ] = ( dist - geo->inner ) / ( geo->outer - geo->inner );
+   }
+   return j;
+}
+
+/**
+   Work out the weights for a row of a rounded rectangle frame.  Only
+   the corners outside the rounded ones get shaded.
+   @param geo where the frame goes.
+   @param y vertical position of the row.
+   @param cols number of pixels in the left half of the row.
+   @param w where to store the weights.
+   @return number of shaded pixels, in from the left edge.
+ */
+static int weighRoundRect( Geometry const *geo, double y, int cols, double *w ) {
+   double qy = fabs( y - geo->centerY ) - geo->sy;
+   double qy2 = qy > 0 ? qy * qy : 0;
+   int j = 0;
+   for ( ; j < cols; j++ ) {
+      double qx = fabs( j + PIXEL_CENTER - geo->centerX ) - geo->sx;
+      double dist = sqrt( ( qx > 0 ? qx * qx : 0 ) + qy2 );
+      if ( !( dist > geo->inner && dist <= geo->outer ) ) {
+         break;
+      }
+      w[ j ] = ( dist - geo->inner ) / ( geo->outer - geo->inner );
+   }
+   return j;
+}
+
+/**
+   Reshape a row of linear weights with a falloff curve.
+   @param falloff the curve.
+   @param w the weights.
+   @param n number of weights.
+ */
+static void applyFalloff( Falloff falloff, double *w, int n ) {
+   if ( falloff == FALLOFF_QUAD ) {
+      for ( int j = 0; j < n; j++ ) {
+         w[ j ] = w[ j ] * w[ j ];
+      }
+   } else if ( falloff == FALLOFF_SMOOTH ) {
+      for ( int j = 0; j < n; j++ ) {
+         w[ j ] = w[ j ] * w[ j ] * ( 3 - 2 * w[ j ] );
+      }
+   }
+}
+
+/**
+   Work out the blend weights for the top-left quarter of an image.
+   The loop for the frame's shape is picked once, up front.
+   @param spec shape of the frame, and its falloff.
+   @param width width of the image.
+   @param height height of the image.
+   @return the new table, or NULL if there's not enough memory.
+ */
+static WeightTable *buildWeights( FrameSpec const *spec, int width, int height ) {
+   Geometry geo;
+   findGeometry( spec, width, height, &geo );
+   RowWeigher weigh = spec->shape == SHAPE_CIRCLE ? weighCircle :
+      spec->shape == SHAPE_ELLIPSE ? weighEllipse : weighRoundRect;
+
+   WeightTable *table = (WeightTable *) malloc( sizeof( WeightTable ) );
+   if ( table == NULL ) {
+      return NULL;
+   }
+   table->width = width;
+   table->height = height;
+   table->spec = *spec;
+   table->refs = 1;
+   table->rows = ( height + 1 ) / 2;
+   table->count = (int *) malloc( table->rows * sizeof( int ) );
+   table->start = (size_t *) malloc( table->rows * sizeof( size_t ) );
+   size_t cap = 1024, n = 0;
+   table->w = (double *) malloc( cap * sizeof( double ) );
+   if ( table->count == NULL || table->start == NULL || table->w == NULL ) {
+      freeWeights( table );
+      return NULL;
+   }
+
+   // Going in from the left edge, pixels only get closer to the center,
+   // so the shaded ones in each row stop at the first one that isn't.
+   int cols = ( width + 1 ) / 2;
+   for ( int i = 0; i < table->rows; i++ ) {
+      // Make sure there's room for a whole row of weights.
+      if ( n + cols > cap ) {
+         while ( n + cols > cap ) {
+            cap *= 2;
+         }
+         double *w = (double *) realloc( table->w, cap * sizeof( double ) );
+         if ( w == NULL ) {
+            freeWeights( table );
+            return NULL;
+         }
+         table->w = w;
+      }
+
+      table->start[ i ] = n;
+      table->count[ i ] = weigh( &geo, i + PIXEL_CENTER, cols, table->w + n );
+      applyFalloff( spec->falloff, table->w + n, table->count[ i ] );
+      n += table->count[ i ];
+   }
+   return table;
+}
+
+/**
+   Return true if two frame specs give the same weights.  The color
+   doesn't matter, and neither does the corner radius unless it's a
+   rounded rectangle.
+   @param a one spec.
+   @param b the other spec.
+   @return true if they give the same weights.
+ */
+static bool sameWeights( FrameSpec const *a, FrameSpec const *b ) {
+   return a->shape == b->shape && a->falloff == b->falloff &&
+      ( a->shape != SHAPE_RRECT || a->radius == b->radius );
+}
+
+/**
+   Drop a reference to a table, and free it if that was the last one.
+   The cache lock has to be held.
+   @param table table to drop.
+ */
+static void dropWeights( WeightTable *table ) {
+   if ( table && --table->refs == 0 ) {
+      freeWeights( table );
+   }
+}
+
+WeightTable const *getWeights( FrameSpec const *spec, int width, int height ) {
+   pthread_mutex_lock( &cacheLock );
+   for ( int k = 0; k < WEIGHT_CACHE; k++ ) {
+      if ( cache[ k ] && cache[ k ]->width == width && cache[ k ]->height == height &&
+           sameWeights( &cache[ k ]->spec, spec ) ) {
+         cache[ k ]->refs++;
+         pthread_mutex_unlock( &cacheLock );
+         return cache[ k ];
+      }
+   }
+
+   // Building a table can take a while, so other threads can use the
+   // cache in the meantime.  If two build the same one, both are kept
+   // until they're pushed out.
+   pthread_mutex_unlock( &cacheLock );
+   WeightTable *table = buildWeights( spec, width, height );
+   if ( table ) {
+      pthread_mutex_lock( &cacheLock );
+      dropWeights( cache[ nextSlot ] );
+      cache[ nextSlot ] = table;
+      nextSlot = ( nextSlot + 1 ) % WEIGHT_CACHE;
+      table->refs++;
+      pthread_mutex_unlock( &cacheLock );
+   }
+   return table;
+}
+
+void releaseWeights( WeightTable const *table ) {
+   pthread_mutex_lock( &cacheLock );
+   dropWeights( (WeightTable *) table );
+   pthread_mutex_unlock( &cacheLock );
+}
+
+/**
+   Find the shaded pixels in part of a row.  An odd width has a middle
+   pixel that's its own mirror image, so it's only counted at the left.
+   @param table the weight table.
+   @param i index of the row in the image.
+   @param from first pixel in the part of the row.
+   @param to pixel after the last one in the part of the row.
+   @param span where to store the shaded pixels.
+ */
+static void findSpan( WeightTable const *table, int i, int from, int to, Span *span ) {
+   int q = i < table->rows ? i : table->height - 1 - i;
+   int count = table->count[ q ];
+   span->w = table->w + table->start[ q ];
+   span->last = table->width - 1;
+   span->leftEnd = count < to ? count : to;
+   span->rightStart = table->width - count;
+   if ( span->rightStart <= span->last / 2 ) {
+      span->rightStart = span->last / 2 + 1;
+   }
+   if ( span->rightStart < from ) {
+      span->rightStart = from;
+   }
+}
+
+bool spanShaded( WeightTable const *table, int i, int from, int to ) {
+   Span span;
+   findSpan( table, i, from, to, &span );
+   return from < span.leftEnd || span.rightStart < to;
+}
+
+/**
+   Shades the pixels based on their original color, frame color and distance from their center.
+   @param color pixel's original color.
+   @param borderColor new frame color to be added.
+   @param w pixel's blend weight.
+   @return the shaded color.
+ */
+static int shade( int color, int borderColor, double w ) {
+   double result = (double)(borderColor * w) + (double)(color * (1 - w));
+   return round(result);
+}
+
+/**
+   Blend one pixel a channel at a time.
+   @param border frame color.
+   @param px the pixel's samples.
+   @param w the pixel's blend weight.
+ */
+static void blendScalar( int const *border, int *px, double w ) {
+   for ( int c = 0; c < RING_CHANNELS; c++ ) {
+      px[ c ] = shade( px[ c ], border[ c ], w );
+   }
+}
+
+/**
+   Shade part of a row one pixel at a time, for processors without SIMD.
+   @param table the weight table.
+   @param border frame color.
+   @param px samples for the first pixel to shade.
+   @param i index of the row.
+   @param from index of the first pixel to shade.
+   @param to index after the last pixel to shade.
+ */
+static void shadeRowScalar( WeightTable const *table, int const *border, int *px, int i,
+                           int from, int to ) {
+   Span span;
+   findSpan( table, i, from, to, &span );
+   for ( int c = from; c < span.leftEnd; c++ ) {
+      blendScalar( border, px + ( c - from ) * RING_CHANNELS, span.w[ c ] );
+   }
+   for ( int c = span.rightStart; c < to; c++ ) {
+      blendScalar( border, px + ( c - from ) * RING_CHANNELS, span.w[ span.last - c ] );
+   }
+}
+
+#ifdef SHADE_X86
+
+/**
+   Blend two pixels with SSE2, given the weight for each sample.  The
+   six samples are in three registers, two to a register, so each one
+   holds parts of both pixels.
+   @param bv frame color for each sample, in the same layout.
+   @param wv weight for each sample.
+   @param px the pixels' samples.
+ */
+__attribute__(( target( "sse2" ) ))
+static void blendPairSSE2( __m128d const bv[ RING_CHANNELS ], __m128d const wv[ RING_CHANNELS ],
+                           int *px ) {
+   __m128d one = _mm_set1_pd( 1 );
+   __m128d half = _mm_set1_pd( 0.5 );
+   for ( int k = 0; k < RING_CHANNELS; k++ ) {
+      __m128i *p = (__m128i *) ( px + 2 * k );
+      __m128d color = _mm_cvtepi32_pd( _mm_loadl_epi64( p ) );
+
+      // The same products and sum as shade(), then round half up.
+      __m128d result = _mm_add_pd( _mm_mul_pd( bv[ k ], wv[ k ] ),
+                                   _mm_mul_pd( color, _mm_sub_pd( one, wv[ k ] ) ) );
+      __m128i whole = _mm_cvttpd_epi32( result );
+      __m128d up = _mm_cmpge_pd( _mm_sub_pd( result, _mm_cvtepi32_pd( whole ) ), half );
+      whole = _mm_sub_epi32( whole, _mm_shuffle_epi32( _mm_castpd_si128( up ), 0x08 ) );
+      _mm_storel_epi64( p, whole );
+   }
+}
+
+/**
+   Blend a run of pixels with SSE2, two at a time.  The weights either
+   go forward from w, or for the mirrored right side of a row,
+   backward from it.
+   @param border frame color.
+   @param px samples for the first pixel.
+   @param w weight for the first pixel.
+   @param n number of pixels.
+   @param mirrored true if the weights go backward.
+ */
+__attribute__(( target( "sse2" ) ))
+static void blendRunSSE2( int const *border, int *px, double const *w, int n, bool mirrored ) {
+   __m128d bv[ RING_CHANNELS ] = {
+      _mm_set_pd( border[ 1 ], border[ 0 ] ),
+      _mm_set_pd( border[ 0 ], border[ 2 ] ),
+      _mm_set_pd( border[ 2 ], border[ 1 ] )
+   };
+   int c = 0;
+   for ( ; c + 2 <= n; c += 2, px += 2 * RING_CHANNELS ) {
+      // Weights for the two pixels, in order, spread out to w0 w0, w0 w1, w1 w1.
+      __m128d pair = mirrored ? _mm_loadu_pd( w - c - 1 ) : _mm_loadu_pd( w + c );
+      if ( mirrored ) {
+         pair = _mm_shuffle_pd( pair, pair, 1 );
+      }
+      __m128d wv[ RING_CHANNELS ] = {
+         _mm_unpacklo_pd( pair, pair ), pair, _mm_unpackhi_pd( pair, pair )
+      };
+      blendPairSSE2( bv, wv, px );
+   }
+   for ( ; c < n; c++, px += RING_CHANNELS ) {
+      blendScalar( border, px, mirrored ? w[ -c ] : w[ c ] );
+   }
+}
+
+/**
+   Shade part of a row with SSE2.
+   @param table the weight table.
+   @param border frame color.
+   @param px samples for the first pixel to shade.
+   @param i index of the row.
+   @param from index of the first pixel to shade.
+   @param to index after the last pixel to shade.
+ */
+__attribute__(( target( "sse2" ) ))
+static void shadeRowSSE2( WeightTable const *table, int const *border, int *px, int i,
+                         int from, int to ) {
+   Span span;
+   findSpan( table, i, from, to, &span );
+   if ( from < span.leftEnd ) {
+      blendRunSSE2( border, px, span.w + from, span.leftEnd - from, false );
+   }
+   if ( span.rightStart < to ) {
+      blendRunSSE2( border, px + ( span.rightStart - from ) * RING_CHANNELS,
+                    span.w + span.last - span.rightStart, to - span.rightStart, true );
+   }
+}
+
+/**
+   Blend four pixels with AVX2, given the weight for each sample.  The
+   twelve samples are in three registers, four to a register.
+   @param bv frame color for each sample, in the same layout.
+   @param wv weight for each sample.
+   @param px the pixels' samples.
+ */
+__attribute__(( target( "avx2" ) ))
+static void blendQuadAVX2( __m256d const bv[ RING_CHANNELS ], __m256d const wv[ RING_CHANNELS ],
+                           int *px ) {
+   __m256d one = _mm256_set1_pd( 1 );
+   __m256d half = _mm256_set1_pd( 0.5 );
+   for ( int k = 0; k < RING_CHANNELS; k++ ) {
+      __m128i *p = (__m128i *) ( px + 4 * k );
+      __m256d color = _mm256_cvtepi32_pd( _mm_loadu_si128( p ) );
+
+      // The same products and sum as shade(), then round half up.
+      __m256d result = _mm256_add_pd( _mm256_mul_pd( bv[ k ], wv[ k ] ),
+                                      _mm256_mul_pd( color, _mm256_sub_pd( one, wv[ k ] ) ) );
+      __m128i whole = _mm256_cvttpd_epi32( result );
+      __m256d up = _mm256_cmp_pd( _mm256_sub_pd( result, _mm256_cvtepi32_pd( whole ) ), half,
+                                  _CMP_GE_OQ );
+      whole = _mm_add_epi32( whole, _mm256_cvtpd_epi32( _mm256_and_pd( up, one ) ) );
+      _mm_storeu_si128( p, whole );
+   }
+}
+
+/**
+   Blend a run of pixels with AVX2, four at a time, the same way as
+   blendRunSSE2().
+   @param border frame color.
+   @param px samples for the first pixel.
+   @param w weight for the first pixel.
+   @param n number of pixels.
+   @param mirrored true if the weights go backward.
+ */
+__attribute__(( target( "avx2" ) ))
+static void blendRunAVX2( int const *border, int *px, double const *w, int n, bool mirrored ) {
+   __m256d bv[ RING_CHANNELS ] = {
+      _mm256_set_pd( border[ 0 ], border[ 2 ], border[ 1 ], border[ 0 ] ),
+      _mm256_set_pd( border[ 1 ], border[ 0 ], border[ 2 ], border[ 1 ] ),
+      _mm256_set_pd( border[ 2 ], border[ 1 ], border[ 0 ], border[ 2 ] )
+   };
+   int c = 0;
+   for ( ; c + 4 <= n; c += 4, px += 4 * RING_CHANNELS ) {
+      // Spread the weights for pixels 0 to 3 out to 0001, 1122, 2333.
+      // Mirrored weights are loaded backward, so they're spread out
+      // from the other end.
+      __m256d wv[ RING_CHANNELS ];
+      if ( mirrored ) {
+         __m256d quad = _mm256_loadu_pd( w - c - 3 );
+         wv[ 0 ] = _mm256_permute4x64_pd( quad, 0xbf );
+         wv[ 1 ] = _mm256_permute4x64_pd( quad, 0x5a );
+         wv[ 2 ] = _mm256_permute4x64_pd( quad, 0x01 );
+      } else {
+         __m256d quad = _mm256_loadu_pd( w + c );
+         wv[ 0 ] = _mm256_permute4x64_pd( quad, 0x40 );
+         wv[ 1 ] = _mm256_permute4x64_pd( quad, 0xa5 );
+         wv[ 2 ] = _mm256_permute4x64_pd( quad, 0xfe );
+      }
+      blendQuadAVX2( bv, wv, px );
+   }
+   for ( ; c < n; c++, px += RING_CHANNELS ) {
+      blendScalar( border, px, mirrored ? w[ -c ] : w[ c ] );
+   }
+}
+
+/**
+   Shade part of a row with AVX2.
+   @param table the weight table.
+   @param border frame color.
+   @param px samples for the first pixel to shade.
+   @param i index of the row.
+   @param from index of the first pixel to shade.
+   @param to index after the last pixel to shade.
+ */
+__attribute__(( target( "avx2" ) ))
+static void shadeRowAVX2( WeightTable const *table, int const *border, int *px, int i,
+                         int from, int to ) {
+   Span span;
+   findSpan( table, i, from, to, &span );
+   if ( from < span.leftEnd ) {
+      blendRunAVX2( border, px, span.w + from, span.leftEnd - from, false );
+   }
+   if ( span.rightStart < to ) {
+      blendRunAVX2( border, px + ( span.rightStart - from ) * RING_CHANNELS,
+                    span.w + span.last - span.rightStart, to - span.rightStart, true );
+   }
+}
+
+#endif
+
+/**
+   Pick the kernel to use, the fastest one the processor supports, or
+   the one named by FRAME_KERNEL.
+ */
+static void pickKernel( void ) {
+   char const *want = getenv( "FRAME_KERNEL" );
+   kernel = shadeRowScalar;
+   kernelName = "scalar";
+   if ( want && strcmp( want, "scalar" ) == 0 ) {
+      return;
+   }
+
+#ifdef SHADE_X86
+   __builtin_cpu_init();
+   if ( __builtin_cpu_supports( "avx2" ) && ( !want || strcmp( want, "avx2" ) == 0 ) ) {
+      kernel = shadeRowAVX2;
+      kernelName = "avx2";
+   } else if ( __builtin_cpu_supports( "sse2" ) ) {
+      kernel = shadeRowSSE2;
+      kernelName = "sse2";
+   }
+#endif
+}
+
+void shadeRow( WeightTable const *table, int const border[ RING_CHANNELS ], int *row, int i ) {
+   pthread_once( &kernelOnce, pickKernel );
+   kernel( table, border, row, i, 0, table->width );
+}
+
+void shadeSpan( WeightTable const *table, int const border[ RING_CHANNELS ], int *px, int i,
+                int from, int to ) {
+   pthread_once( &kernelOnce, pickKernel );
+   kernel( table, border, px, i, from, to );
+}
+
+char const *shadeKernel( void ) {
+   pthread_once( &kernelOnce, pickKernel );
+   return kernelName;
+}
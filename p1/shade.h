@@ -0,0 +1,138 @@
+/**
+   @file shade.h
+   @author Prem Subedi
+   Header for the shade component, which blends the frame color into
+   a row of pixels.  The blend weight of each pixel only depends on
+   the size of the image, so the weights are worked out once for each
+   size and kept for the next image that's the same size.  There are
+   SIMD blends for SSE2 and AVX2 and a plain C one, and the best one
+   the processor supports is picked the first time a row is shaded.
+   They all give exactly the same output.
+ */
+
+#ifndef SHADE_H
+#define SHADE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/** Number of samples in a pixel. */
+#define RING_CHANNELS 3
+
+/** Shapes the frame can have.  The inside edge of the frame is a
+    circle touching the nearest two edges of the image, an ellipse
+    touching all four, or a rectangle with rounded corners. */
+typedef enum { SHAPE_CIRCLE, SHAPE_ELLIPSE, SHAPE_RRECT } FrameShape;
+
+/** How the frame color comes in, from the inside edge of the frame
+    out to the corners, straight across, slow then fast, or easing in
+    and out. */
+typedef enum { FALLOFF_LINEAR, FALLOFF_QUAD, FALLOFF_SMOOTH } Falloff;
+
+/** What the frame looks like. */
+typedef struct {
+   /** Shape of the inside edge. */
+   FrameShape shape;
+
+   /** How the color comes in. */
+   Falloff falloff;
+
+   /** Corner radius of a rounded rectangle in pixels, or -1 for a
+       quarter of the shorter side. */
+   int radius;
+
+   /** Frame color, from 0 to 255. */
+   int color[ RING_CHANNELS ];
+} FrameSpec;
+
+/** Blend weights for the pixels under the frame, for one image size.
+    The frame is the same in all four corners, mirrored about the
+    center, so this only holds the top-left quarter of the image.  In
+    each row of the quarter, the shaded pixels run from the left edge
+    in toward the middle. */
+typedef struct {
+   /** Size of the image. */
+   int width;
+   int height;
+
+   /** Frame the weights are for. */
+   FrameSpec spec;
+
+   /** Number of users of the table, counting the cache. */
+   int refs;
+
+   /** Number of rows in the quarter, half the height rounded up. */
+   int rows;
+
+   /** Number of shaded pixels in each row of the quarter. */
+   int *count;
+
+   /** Index in w of the first weight for each row of the quarter. */
+   size_t *start;
+
+   /** Weights, from 0 at the frame's radius to 1 at the corner. */
+   double *w;
+} WeightTable;
+
+/**
+   Return the blend weights for a frame on an image of the given size.
+   The last few tables are kept, so images of the same size with the
+   same frame share one, even if they're framed on different threads.
+   @param spec the frame.
+   @param width width of the image.
+   @param height height of the image.
+   @return the weights, or NULL if there's not enough memory.  The
+   caller gives them back with releaseWeights().
+ */
+WeightTable const *getWeights( FrameSpec const *spec, int width, int height );
+
+/**
+   Give back a table from getWeights().  It's freed once it's out of
+   the cache and nobody else is using it.
+   @param table the table.
+ */
+void releaseWeights( WeightTable const *table );
+
+/**
+   Shade one row of pixels, blending each one under the frame toward
+   the frame color, more the farther out it is.
+   @param table blend weights for the image.
+   @param border frame color, scaled to the image's maximum sample value.
+   @param row samples for the row, three for each pixel.
+   @param i index of the row.
+ */
+void shadeRow( WeightTable const *table, int const border[ RING_CHANNELS ], int *row, int i );
+
+/**
+   Shade part of a row of pixels, the same way shadeRow() would.
+   @param table blend weights for the image.
+   @param border frame color, scaled to the image's maximum sample value.
+   @param px samples for the first pixel to shade, three for each pixel.
+   @param i index of the row.
+   @param from index of the first pixel to shade.
+   @param to index after the last pixel to shade.
+ */
+void shadeSpan( WeightTable const *table, int const border[ RING_CHANNELS ], int *px, int i,
+                int from, int to );
+
+/**
+   Return true if any pixel in part of a row is under the frame, so
+   it would be changed by shadeSpan().
+   @param table blend weights for the image.
+   @param i index of the row.
+   @param from index of the first pixel.
+   @param to index after the last pixel.
+   @return true if some of the pixels get shaded.
+ */
+bool spanShaded( WeightTable const *table, int i, int from, int to );
+
+/**
+   Return the name of the version of shadeRow() being used, "avx2",
+   "sse2" or "scalar".  Setting the FRAME_KERNEL environment variable
+   to one of these names chooses that one instead, if the processor
+   supports it.
+   @return name of the kernel.
+ */
+char const *shadeKernel( void );
+
+#endif
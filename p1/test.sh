@@ -37,11 +37,13 @@ testMagic() {
 testFrame() {
   TESTNO=$1
   ESTATUS=$2
+  FLAGS=$3
+  EXPECTED=${4:-expected-f$TESTNO.ppm}
 
   rm -f output.ppm
 
-  echo "Frame test $TESTNO: ./frame < input-f$TESTNO.ppm > output.ppm"
-  ./frame < input-f$TESTNO.ppm > output.ppm
+  echo "Frame test $TESTNO: ./frame $FLAGS < input-f$TESTNO.ppm > output.ppm"
+  ./frame $FLAGS < input-f$TESTNO.ppm > output.ppm
   STATUS=$?
 
   # Make sure the program exited with the right exit status.
@@ -55,7 +57,7 @@ testFrame() {
   # unsuccessfully
   if [ $ESTATUS -eq 0 ] ; then
       # Make sure the output matches the expected output.
-      if ! diff -q expected-f$TESTNO.ppm output.ppm >/dev/null 2>&1 ; then
+      if ! cmp -s $EXPECTED output.ppm ; then
 	  echo "**** Frame test $TESTNO FAILED - output didn't match the expected output"
 	  FAIL=1
 	  return 1
@@ -66,6 +68,59 @@ testFrame() {
   return 0
 }
 
+# Function to run the frame program on a batch of images, and check
+# that each one that can be framed matches its expected output
+testBatch() {
+  ESTATUS=$1
+  FLAGS=$2
+  shift 2
+
+  OUTDIR=$(mktemp -d)
+  INDIR=$(mktemp -d)
+  FILES=""
+  for TESTNO in "$@" ; do
+      FILES="$FILES input-f$TESTNO.ppm"
+      cp input-f$TESTNO.ppm $INDIR
+  done
+
+  # With a directory, frame the copies in it instead of naming each file.
+  if [ "$FLAGS" = "dir" ]; then
+      FLAGS=""
+      FILES=" $INDIR"
+  fi
+
+  echo "Frame batch test: ./frame $FLAGS --batch $OUTDIR$FILES"
+  ./frame $FLAGS --batch $OUTDIR $FILES 2> /dev/null
+  STATUS=$?
+  rm -rf $INDIR
+
+  if [ $STATUS -ne $ESTATUS ]; then
+      echo "**** Frame batch test FAILED - incorrect exit status. Expected: $ESTATUS Got: $STATUS"
+      FAIL=1
+      rm -rf $OUTDIR
+      return 1
+  fi
+
+  # Images that can't be framed don't leave an output file behind.
+  for TESTNO in "$@" ; do
+      if [ -f expected-f$TESTNO.ppm ] ; then
+          cmp -s expected-f$TESTNO.ppm $OUTDIR/input-f$TESTNO.ppm
+      else
+          [ ! -e $OUTDIR/input-f$TESTNO.ppm ]
+      fi
+      if [ $? -ne 0 ] ; then
+          echo "**** Frame batch test FAILED - output for input-f$TESTNO.ppm didn't match"
+          FAIL=1
+          rm -rf $OUTDIR
+          return 1
+      fi
+  done
+
+  rm -rf $OUTDIR
+  echo "Frame batch test PASS"
+  return 0
+}
+
 # make a fresh copy of the target programs
 make clean
 make
@@ -78,6 +133,16 @@ if [ -x magic ] ; then
     testMagic 3 0
     testMagic 4 0
     testMagic 5 0
+
+    # Each version of the text scanner has to give the same output.
+    for KERNEL in scalar sse2 avx2 ; do
+        echo "Text scanner $KERNEL"
+        export MAGIC_KERNEL=$KERNEL
+        testMagic 2 0
+        testMagic 3 0
+        testMagic 5 0
+    done
+    unset MAGIC_KERNEL
 else
     echo "**** Magic program didn't compile successfully"
     FAIL=1
@@ -92,6 +157,89 @@ if [ -x frame ] ; then
     testFrame 6 100
     testFrame 7 101
     testFrame 8 102
+
+    # Binary PPM, with 8 and 16-bit samples, and converting between
+    # ASCII and binary.
+    testFrame 9 0
+    testFrame 10 0
+    testFrame 9 0 --p3 expected-f4.ppm
+    testFrame 4 0 --p6 expected-f9.ppm
+
+    # Each version of the shading kernel has to give the same output.
+    for KERNEL in scalar sse2 avx2 ; do
+        echo "Shading kernel $KERNEL"
+        export FRAME_KERNEL=$KERNEL
+        testFrame 2 0
+        testFrame 4 0
+        testFrame 10 0
+    done
+    unset FRAME_KERNEL
+
+    # Framing on several threads doesn't change the image.
+    testFrame 4 0 "-j 3"
+    testFrame 10 0 "-j 4"
+    testFrame 9 0 "-j 2 --p3" expected-f4.ppm
+    testFrame 8 102 "-j 2"
+
+    # Tiled framing of binary images, and ASCII images it doesn't apply to.
+    testFrame 9 0 --tiled
+    testFrame 10 0 "--tiled -j 2"
+    testFrame 4 0 "--tiled --p6" expected-f9.ppm
+    testFrame 2 0 --tiled
+
+    # Other frame shapes, colors and falloffs.
+    testFrame 4 0 "--frame shape=ellipse,color=ff8000,falloff=smooth" expected-f11.ppm
+    testFrame 9 0 "-j 2 --p3 --frame shape=ellipse,color=#ff8000,falloff=smooth" expected-f11.ppm
+    testFrame 3 0 "--frame shape=rrect,radius=4,color=20c040,falloff=quad" expected-f12.ppm
+    testFrame 4 1 "--frame shape=star"
+
+    # Standard input that's already been partly read starts where it
+    # was left, not at the start of the file.
+    echo "Frame offset test: ( dd bs=1 count=4; ./frame ) < input"
+    ( printf "junk" ; cat input-f9.ppm ) > output.ppm
+    ( dd bs=1 count=4 of=/dev/null 2> /dev/null ; ./frame > output-offset.ppm ) < output.ppm
+    if cmp -s expected-f9.ppm output-offset.ppm ; then
+        echo "Frame offset test PASS"
+    else
+        echo "**** Frame offset test FAILED - output didn't match"
+        FAIL=1
+    fi
+    rm -f output-offset.ppm
+
+    # Batches of images, some the same size so they share weights, on
+    # one thread or several, and all the images in a directory.
+    testBatch 0 "" 1 2 3 4 5 9 10
+    testBatch 102 "" 2 8 4 6 10
+    testBatch 0 "-j 3 --stats" 1 2 3 4 5 9 10
+    testBatch 102 "-j 2" 2 8 4 6 10
+    testBatch 0 dir 1 3 4 10
+
+    # A batch that would write over its own inputs isn't framed at all.
+    INDIR=$(mktemp -d)
+    cp input-f4.ppm input-f9.ppm $INDIR
+    echo "Frame batch test: ./frame --batch $INDIR $INDIR"
+    ./frame --batch $INDIR $INDIR 2> /dev/null
+    STATUS=$?
+    if [ $STATUS -ne 1 ] || ! cmp -s input-f4.ppm $INDIR/input-f4.ppm ||
+       ! cmp -s input-f9.ppm $INDIR/input-f9.ppm ; then
+        echo "**** Frame batch test FAILED - inputs were overwritten (status $STATUS)"
+        FAIL=1
+    else
+        echo "Frame batch test PASS"
+    fi
+
+    # Neither is one that would frame two images to the same file.
+    OUTDIR=$(mktemp -d)
+    echo "Frame batch test: ./frame -j 2 --batch $OUTDIR input-f4.ppm $INDIR/input-f9.ppm input-f9.ppm"
+    ./frame -j 2 --batch $OUTDIR input-f4.ppm $INDIR/input-f9.ppm input-f9.ppm 2> /dev/null
+    STATUS=$?
+    if [ $STATUS -ne 1 ] || [ -n "$(ls $OUTDIR)" ] ; then
+        echo "**** Frame batch test FAILED - clashing outputs were framed (status $STATUS)"
+        FAIL=1
+    else
+        echo "Frame batch test PASS"
+    fi
+    rm -rf $INDIR $OUTDIR
 else
     echo "**** Magic program didn't compile successfully"
     FAIL=1
@@ -0,0 +1,72 @@
+/**
+   @file arena.c
+   @author Prem Subedi
+   This component hands out memory from large blocks, so the many small
+   objects that make up a parsed program don't each need their own
+   malloc(), and can all be freed at once.
+ */
+
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+/** Usual size of a block, in bytes. */
+#define BLOCK_SIZE 65536
+
+/** Every allocation starts at a multiple of this. */
+#define ALIGNMENT 16
+
+/** Header at the start of each block, linking it to the one
+    allocated before it. */
+struct ArenaBlockStruct {
+  /** Previous block, or NULL for the first one. */
+  ArenaBlock *prev;
+
+  /** Padding, so memory after the header is aligned. */
+  char pad[ ALIGNMENT - sizeof( ArenaBlock * ) ];
+};
+
+void initArena( Arena *arena )
+{
+  arena->head = NULL;
+  arena->next = arena->end = NULL;
+}
+
+void *arenaAlloc( Arena *arena, size_t size )
+{
+  size = ( size + ALIGNMENT - 1 ) & ~(size_t) ( ALIGNMENT - 1 );
+  if ( size > (size_t) ( arena->end - arena->next ) ) {
+    // Start a new block, big enough for this allocation if it's a
+    // large one.
+    size_t bsize = BLOCK_SIZE - sizeof( ArenaBlock );
+    if ( size > bsize )
+      bsize = size;
+    ArenaBlock *block = (ArenaBlock *) malloc( sizeof( ArenaBlock ) + bsize );
+    block->prev = arena->head;
+    arena->head = block;
+    arena->next = (char *) ( block + 1 );
+    arena->end = arena->next + bsize;
+  }
+
+  void *mem = arena->next;
+  arena->next += size;
+  return mem;
+}
+
+char *arenaCopy( Arena *arena, char const *str, int len )
+{
+  char *cpy = (char *) arenaAlloc( arena, len + 1 );
+  memcpy( cpy, str, len );
+  cpy[ len ] = '\0';
+  return cpy;
+}
+
+void freeArena( Arena *arena )
+{
+  while ( arena->head ) {
+    ArenaBlock *prev = arena->head->prev;
+    free( arena->head );
+    arena->head = prev;
+  }
+  arena->next = arena->end = NULL;
+}
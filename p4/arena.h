@@ -0,0 +1,57 @@
+/**
+  @file arena.h
+  @author Prem Subedi
+  Bump allocator for objects that all live as long as the program
+  they belong to, so they can be freed together.
+*/
+
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stddef.h>
+
+/** It's weird, but you can give a short name to a struct before you define it. */
+typedef struct ArenaBlockStruct ArenaBlock;
+
+/** Memory that's handed out in pieces, one block at a time.  Pieces
+    are allocated one after another in the current block, so objects
+    allocated together are next to each other in memory. */
+typedef struct {
+  /** Most recently allocated block, the one we're allocating from. */
+  ArenaBlock *head;
+
+  /** Next free byte in the current block. */
+  char *next;
+
+  /** End of the current block. */
+  char *end;
+} Arena;
+
+/** Initialize an empty arena.
+    @param arena Address of the structure to initialize.
+*/
+void initArena( Arena *arena );
+
+/** Allocate memory from an arena.  The memory is suitably aligned
+    for any object, and it stays valid until the arena is freed.
+    @param arena Arena to allocate from.
+    @param size Number of bytes needed.
+    @return pointer to the new memory.
+*/
+void *arenaAlloc( Arena *arena, size_t size );
+
+/** Copy the given characters to a new, null terminated string in
+    an arena.
+    @param arena Arena to allocate the copy from.
+    @param str start of the characters to copy.
+    @param len number of characters to copy.
+    @return copied string.
+*/
+char *arenaCopy( Arena *arena, char const *str, int len );
+
+/** Free all the memory allocated from an arena, at once.
+    @param arena Arena to free.
+*/
+void freeArena( Arena *arena );
+
+#endif
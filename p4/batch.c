@@ -0,0 +1,170 @@
+/**
+   @file batch.c
+   @author Prem Subedi
+   This component runs one compiled program many times, each with its
+   own inputs, on a pool of worker threads.  Each run writes to its own
+   output buffers, and the buffers are copied out in the order the
+   inputs were given, no matter what order the runs finish in.  The
+   workers only get a few jobs ahead of the one being copied out, so a
+   slow run doesn't leave the output of all the runs after it waiting
+   in memory.
+ */
+
+#include "program.h"
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+/** Number of jobs for each worker that can be started past the first
+    one that hasn't been copied out yet. */
+#define JOBS_PER_THREAD 4
+
+/** One run in a batch, and what it produced. */
+typedef struct {
+  /** Starting values of the variables for this run. */
+  char const *const *bindings;
+
+  /** Output of the run, and its length. */
+  char *out;
+  int outLen;
+
+  /** Error message from the run, if any, and its length. */
+  char *err;
+  size_t errLen;
+
+  /** Exit status of the run. */
+  int status;
+
+  /** True once the run has finished and its output can be copied. */
+  bool done;
+} Job;
+
+/** State shared by all the workers in a batch. */
+typedef struct {
+  /** Program every job runs.  This is only read while the batch runs. */
+  NondeProgram const *prog;
+
+  /** All the jobs, in input order. */
+  Job *jobs;
+
+  /** Number of jobs. */
+  int count;
+
+  /** Index of the next job to start. */
+  int next;
+
+  /** Number of jobs that have been copied out. */
+  int copied;
+
+  /** Most jobs that can be started past the last one copied out. */
+  int window;
+
+  /** Lock for next and copied, and for the done flag in each job. */
+  pthread_mutex_t lock;
+
+  /** Signaled whenever a job finishes. */
+  pthread_cond_t finished;
+
+  /** Signaled whenever a job is copied out, making room for another. */
+  pthread_cond_t room;
+} Batch;
+
+/**
+   Start function for a worker thread.  It runs jobs until there are
+   none left to start, waiting whenever it gets too far ahead of the
+   output.
+   @param arg the batch, as a void pointer.
+   @return NULL.
+*/
+static void *worker( void *arg )
+{
+  Batch *batch = (Batch *) arg;
+  while ( true ) {
+    pthread_mutex_lock( &batch->lock );
+    while ( batch->next < batch->count && batch->next >= batch->copied + batch->window )
+      pthread_cond_wait( &batch->room, &batch->lock );
+    int i = batch->next++;
+    pthread_mutex_unlock( &batch->lock );
+    if ( i >= batch->count )
+      return NULL;
+
+    // Run the job, collecting its output in memory.
+    Job *job = batch->jobs + i;
+    Output out;
+    initMemoryOutput( &out );
+    FILE *err = open_memstream( &job->err, &job->errLen );
+    job->status = runCode( &batch->prog->code, job->bindings, &out, err, NULL );
+    fclose( err );
+    job->out = out.data;
+    job->outLen = out.len;
+
+    pthread_mutex_lock( &batch->lock );
+    job->done = true;
+    pthread_cond_broadcast( &batch->finished );
+    pthread_mutex_unlock( &batch->lock );
+  }
+}
+
+int nondeRunBatch( NondeProgram const *prog, char const *const *const *inputs, int count,
+                   int threads, FILE *out, FILE *err )
+{
+  Batch batch;
+  batch.prog = prog;
+  batch.jobs = (Job *) calloc( count + 1, sizeof( Job ) );
+  batch.count = count;
+  batch.next = 0;
+  batch.copied = 0;
+  pthread_mutex_init( &batch.lock, NULL );
+  pthread_cond_init( &batch.finished, NULL );
+  pthread_cond_init( &batch.room, NULL );
+  for ( int i = 0; i < count; i++ )
+    batch.jobs[ i ].bindings = inputs[ i ];
+
+  // No point in more workers than jobs.
+  if ( threads > count )
+    threads = count;
+  if ( threads < 1 )
+    threads = 1;
+  batch.window = threads * JOBS_PER_THREAD;
+  pthread_t *pool = (pthread_t *) malloc( threads * sizeof( pthread_t ) );
+  for ( int t = 0; t < threads; t++ )
+    pthread_create( pool + t, NULL, worker, &batch );
+
+  // Copy out the results in order, as each one is ready.
+  Output output;
+  initStreamOutput( &output, out );
+  int status = 0;
+  for ( int i = 0; i < count; i++ ) {
+    Job *job = batch.jobs + i;
+    pthread_mutex_lock( &batch.lock );
+    while ( !job->done )
+      pthread_cond_wait( &batch.finished, &batch.lock );
+    pthread_mutex_unlock( &batch.lock );
+
+    outputText( &output, job->out, job->outLen );
+    if ( job->errLen ) {
+      flushOutput( &output );
+      fwrite( job->err, 1, job->errLen, err );
+    }
+    free( job->out );
+    free( job->err );
+    if ( job->status )
+      status = job->status;
+
+    pthread_mutex_lock( &batch.lock );
+    batch.copied++;
+    pthread_cond_broadcast( &batch.room );
+    pthread_mutex_unlock( &batch.lock );
+  }
+
+  freeOutput( &output );
+
+  for ( int t = 0; t < threads; t++ )
+    pthread_join( pool[ t ], NULL );
+  free( pool );
+  pthread_mutex_destroy( &batch.lock );
+  pthread_cond_destroy( &batch.finished );
+  pthread_cond_destroy( &batch.room );
+  free( batch.jobs );
+  return status;
+}
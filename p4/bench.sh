@@ -0,0 +1,256 @@
+#!/bin/bash
+# Benchmarks for nonde.  This generates a few scripts that each stress
+# one part of the interpreter, runs each of them a few times and
+# reports instructions per second, parse speed and peak memory use.
+# The results are compared against a baseline, and anything that got
+# slower (or bigger) by more than BENCH_TOLERANCE percent fails the run.
+# Timings from another machine mean nothing here, so the baseline is
+# measured on this one: by default the nonde in git revision BENCH_BASE
+# (HEAD if it's not set) is built in a scratch directory and run on the
+# same workloads.  With --update, the results are saved in
+# bench-baseline.txt, along with the machine and compiler they came
+# from, and later runs compare against that file instead.
+FAIL=0
+BASELINE=bench-baseline.txt
+BASE_REV=${BENCH_BASE:-HEAD}
+TOLERANCE=${BENCH_TOLERANCE:-30}
+RUNS=${BENCH_RUNS:-5}
+UPDATE=0
+if [ "$1" = "--update" ] ; then
+    UPDATE=1
+fi
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# Nested counting loops, mostly arithmetic and branches.
+genLoops() {
+  cat <<'EOF'
+set i "0";
+outer:
+  set j "0";
+  inner:
+    add j j "1";
+    less t j "1000";
+    if t inner;
+  add i i "1";
+  less t i "6000";
+  if t outer;
+EOF
+}
+
+# A long chain of labels, each jumping to the next, run in a loop.
+genLabels() {
+  awk 'BEGIN {
+    print "set n \"0\";";
+    print "top:";
+    for ( i = 0; i < 2000; i++ ) {
+      printf "goto l%d;\n", i;
+      printf "l%d:\n", i;
+    }
+    print "add n n \"1\";";
+    print "less t n \"2000\";";
+    print "if t top;";
+  }'
+}
+
+# Lots of small prints.
+genPrint() {
+  cat <<'EOF'
+set i "0";
+top:
+  print i;
+  print " ";
+  add i i "1";
+  less t i "3000000";
+  if t top;
+EOF
+}
+
+# Multiply, add, divide and mod in a loop.
+genArith() {
+  cat <<'EOF'
+set i "1";
+set sum "0";
+top:
+  mult a i "7919";
+  add a a i;
+  div q a "13";
+  mod r a "13";
+  add sum sum q;
+  sub sum sum r;
+  add i i "1";
+  less t i "3000000";
+  if t top;
+print sum;
+print "\n";
+EOF
+}
+
+# A big script that's parsed but never runs past its first line.
+genParse() {
+  awk 'BEGIN {
+    print "goto end;";
+    for ( i = 0; i < 200000; i++ ) {
+      printf "add v%d v%d \"%d\";\n", i % 500, ( i + 1 ) % 500, i;
+      if ( i % 100 == 0 )
+        printf "b%d:\n", i;
+    }
+    print "end:";
+  }'
+}
+
+# Pull one field out of the stats line nonde prints.
+statField() {
+  sed -n "s/^stats: .*$1 \([0-9.]*\).*/\1/p" "$2"
+}
+
+# Run one workload with the nonde in $PROG and record its results in
+# RESULTS.
+benchNonde() {
+  NAME=$1
+  SCRIPT=$WORK/$NAME.txt
+  gen$2 > $SCRIPT
+
+  # Profiling counts every instruction, it's just too slow to time.
+  if ! $PROG --profile $SCRIPT > /dev/null 2> $WORK/profile.txt ; then
+      echo "**** Benchmark $NAME FAILED - script didn't run"
+      FAIL=1
+      return 1
+  fi
+  INSTR=$(sed -n 's/^Profile: \([0-9]*\) instructions.*/\1/p' $WORK/profile.txt)
+
+  # Keep the best of a few runs, time on a busy machine only goes up.
+  BEST_PARSE=""
+  BEST_RUN=""
+  RSS=0
+  for (( r = 0; r < RUNS; r++ )) ; do
+    $PROG --stats $SCRIPT > /dev/null 2> $WORK/stats.txt
+    BYTES=$(statField parse $WORK/stats.txt)
+    PARSE=$(statField "bytes in" $WORK/stats.txt)
+    RUN=$(statField run $WORK/stats.txt)
+    PEAK=$(sed -n 's/^stats: .*peak RSS \([0-9]*\).*/\1/p' $WORK/stats.txt)
+    if [ -z "$BEST_PARSE" ] || awk "BEGIN { exit !( $PARSE < $BEST_PARSE ) }" ; then
+        BEST_PARSE=$PARSE
+    fi
+    if [ -z "$BEST_RUN" ] || awk "BEGIN { exit !( $RUN < $BEST_RUN ) }" ; then
+        BEST_RUN=$RUN
+    fi
+    if [ $PEAK -gt $RSS ] ; then
+        RSS=$PEAK
+    fi
+  done
+
+  IPS=$(awk "BEGIN { printf \"%.0f\", $INSTR / ( $BEST_RUN > 0 ? $BEST_RUN : 1e-6 ) }")
+  MBPS=$(awk "BEGIN { printf \"%.1f\", $BYTES / 1e6 / ( $BEST_PARSE > 0 ? $BEST_PARSE : 1e-6 ) }")
+  printf "%-8s %12s %10s %12s %10s %10s\n" $NAME $INSTR $BEST_RUN $IPS $MBPS $RSS
+
+  # The parse workload hardly runs, so its instruction rate means nothing.
+  if [ $NAME = parse ] ; then
+      RESULTS="$RESULTS$NAME mbps $MBPS"$'\n'
+  else
+      RESULTS="$RESULTS$NAME ips $IPS"$'\n'
+  fi
+  RESULTS="$RESULTS$NAME rss $RSS"$'\n'
+}
+
+# Compare one result against the baseline.  Rates have to stay above
+# it and memory use has to stay below it, within the tolerance.
+checkResult() {
+  NAME=$1
+  METRIC=$2
+  VALUE=$3
+  OLD=$(awk -v n=$NAME -v m=$METRIC '$1 == n && $2 == m { print $3 }' <<< "$BASE_RESULTS")
+  if [ -z "$OLD" ] ; then
+      echo "Benchmark $NAME $METRIC: no baseline"
+      return 0
+  fi
+
+  if [ $METRIC = rss ] ; then
+      BAD=$(awk "BEGIN { print ( $VALUE > $OLD * ( 100 + $TOLERANCE ) / 100 ) }")
+  else
+      BAD=$(awk "BEGIN { print ( $VALUE < $OLD * ( 100 - $TOLERANCE ) / 100 ) }")
+  fi
+  CHANGE=$(awk "BEGIN { printf \"%+.1f\", ( $VALUE - $OLD ) * 100 / $OLD }")
+  if [ $BAD -ne 0 ] ; then
+      echo "**** REGRESSION: $NAME $METRIC is $VALUE, baseline $OLD ($CHANGE%)"
+      FAIL=1
+  else
+      echo "Benchmark $NAME $METRIC: $VALUE, baseline $OLD ($CHANGE%)"
+  fi
+}
+
+# Run every workload with the nonde in $PROG, leaving the results in
+# RESULTS.
+benchAll() {
+  RESULTS=""
+  printf "%-8s %12s %10s %12s %10s %10s\n" workload instrs "run (s)" "instr/s" "parse MB/s" "RSS (KB)"
+  benchNonde loops Loops
+  benchNonde labels Labels
+  benchNonde print Print
+  benchNonde arith Arith
+  benchNonde parse Parse
+}
+
+# make a fresh copy of the program
+make nonde > /dev/null || exit 1
+
+PROG=./nonde
+echo "Current build:"
+benchAll
+
+if [ $FAIL -ne 0 ]; then
+  echo "FAILING BENCHMARKS!"
+  exit 13
+fi
+
+if [ $UPDATE -ne 0 ] ; then
+    {
+      echo "# machine: $(uname -srm), $(grep -m 1 '^model name' /proc/cpuinfo 2> /dev/null | sed 's/.*: //')"
+      echo "# compiler: $(gcc --version | head -n 1)"
+      printf "%s" "$RESULTS"
+    } > $BASELINE
+    echo "Saved new baseline in $BASELINE"
+    exit 0
+fi
+
+echo
+if [ -f $BASELINE ] ; then
+    echo "Baseline from $BASELINE:"
+    sed -n 's/^# //p' $BASELINE
+    BASE_RESULTS=$(grep -v '^#' $BASELINE)
+else
+    # Build the baseline revision from a clean copy, so the working
+    # tree doesn't matter.
+    mkdir $WORK/base
+    if ! git archive $BASE_REV . | tar -x -C $WORK/base ||
+       ! make -C $WORK/base nonde > /dev/null ; then
+        echo "**** Can't build the baseline from $BASE_REV"
+        exit 13
+    fi
+    CURRENT=$RESULTS
+    PROG=$WORK/base/nonde
+    echo "Baseline, $BASE_REV built on this machine:"
+    benchAll
+    if [ $FAIL -ne 0 ]; then
+      echo "FAILING BENCHMARKS!"
+      exit 13
+    fi
+    BASE_RESULTS=$RESULTS
+    RESULTS=$CURRENT
+fi
+
+echo
+while read NAME METRIC VALUE ; do
+  if [ -n "$NAME" ] ; then
+    checkResult $NAME $METRIC $VALUE
+  fi
+done <<< "$RESULTS"
+
+if [ $FAIL -ne 0 ]; then
+  echo "BENCHMARK REGRESSIONS!"
+  exit 1
+else
+  echo "Benchmarks within ${TOLERANCE}% of the baseline"
+  exit 0
+fi
@@ -0,0 +1,437 @@
+/**
+   @file bytecode.c
+   @author Prem Subedi
+   This component contains the interpreter for compiled programs.  It
+   walks the instruction array with a single switch on the opcode, so
+   running a command doesn't need a call through a function pointer,
+   and branches jump straight to their pre-resolved targets.  Variables
+   live in an array of values indexed by slot, so arithmetic works on
+   integers directly instead of going through the environment as text.
+   All the state for a run is kept in one structure, so a compiled
+   program can be run in several threads at once.  Loops that run
+   often enough are recorded as traces, which run without going
+   through the dispatch loop.
+ */
+
+#include "bytecode.h"
+#include "trace.h"
+#include "text.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include <time.h>
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <x86intrin.h>
+#endif
+
+/** Number of times a backward jump has to go to the same place before
+    we record a trace for the loop. */
+#define HOT_LOOP 50
+
+/** How many more jumps to wait before trying again at a loop that
+    couldn't be traced, or whose trace wasn't useful. */
+#define BACKOFF 5000
+
+/** State for one run of a program. */
+typedef struct {
+  /** Program being run. */
+  Code const *code;
+
+  /** Values for all the slots. */
+  Value *frame;
+
+  /** Buffer for the program's output. */
+  Output *out;
+
+  /** Stream for a runtime error message. */
+  FILE *err;
+
+  /** Where to go back to if there's a runtime error. */
+  jmp_buf fail;
+
+  /** For each instruction, how many times a backward jump has gone
+      there, or NULL until the first backward jump. */
+  int *hot;
+
+  /** For each instruction, the trace for the loop starting there, if
+      there is one. */
+  Trace **traces;
+} Run;
+
+/**
+   Print an error message for a runtime error, then stop the run.
+   @param run the run that failed.
+   @param format printf-style format for the message.
+*/
+static void runtimeError( Run *run, char const *format, ... )
+{
+  // Anything the program printed comes before the message.
+  flushOutput( run->out );
+
+  va_list ap;
+  va_start( ap, format );
+  vfprintf( run->err, format, ap );
+  va_end( ap );
+  longjmp( run->fail, 1 );
+}
+
+/**
+   Return the value in the given slot, stopping with an error message
+   if it's an undefined variable.
+   @param run the current run.
+   @param slot slot to read.
+   @param line source line of the instruction.
+   @return the value in the slot.
+*/
+static Value const *readSlot( Run *run, int slot, int line )
+{
+  if ( run->frame[ slot ].type == VAL_UNDEF )
+    runtimeError( run, "Undefined variable: %s (line %d)\n",
+                  run->code->vars->names[ slot ], line );
+  return run->frame + slot;
+}
+
+bool computeArithmetic( Opcode op, int64_t l1, int64_t l2, int64_t *ans )
+{
+  switch ( op ) {
+  case OP_ADD:
+    return !__builtin_add_overflow( l1, l2, ans );
+  case OP_SUB:
+    return !__builtin_sub_overflow( l1, l2, ans );
+  case OP_MULT:
+    return !__builtin_mul_overflow( l1, l2, ans );
+  default:
+    // The only quotient that doesn't fit is the smallest number
+    // divided by -1, and dividing that in C is undefined.
+    if ( l2 == -1 ) {
+      *ans = op == OP_MOD ? 0 : (int64_t) ( 0 - (uint64_t) l1 );
+      return op == OP_MOD || l1 != INT64_MIN;
+    }
+    *ans = op == OP_MOD ? l1 % l2 : l1 / l2;
+    return true;
+  }
+}
+
+/**
+   Compute the result of an arithmetic or comparison instruction and
+   store it in the destination slot.  A divmod stores both the
+   quotient and the remainder.
+   @param run the current run.
+   @param in the instruction to run.
+*/
+static void runArithmetic( Run *run, Instr const *in )
+{
+  Value *frame = run->frame;
+  Value const *v1 = readSlot( run, in->arg[ 1 ], in->line );
+  Value const *v2 = readSlot( run, in->arg[ 2 ], in->line );
+  if ( !v1->numeric || !v2->numeric )
+    runtimeError( run, "Invalid number (line %d)\n", in->line );
+
+  int64_t l1 = v1->num;
+  int64_t l2 = v2->num;
+  int64_t ans, rem;
+  switch ( in->op ) {
+  case OP_EQ:
+  case OP_JEQ:
+    copyValue( frame + in->arg[ 0 ], l1 == l2 ? &trueValue : &falseValue );
+    return;
+  case OP_LESS:
+  case OP_JLESS:
+    copyValue( frame + in->arg[ 0 ], l1 < l2 ? &trueValue : &falseValue );
+    return;
+  case OP_DIV:
+  case OP_MOD:
+  case OP_DIVMOD:
+    if ( l2 == 0 )
+      runtimeError( run, "Divide by zero (line %d)\n", in->line );
+    break;
+  default:
+    break;
+  }
+
+  if ( in->op == OP_DIVMOD ) {
+    // The compiler gets both results from one divide.  The remainder
+    // is stored second, so it wins if both go to the same variable.
+    if ( !computeArithmetic( OP_DIV, l1, l2, &ans ) && run->code->checkOverflow )
+      runtimeError( run, "Integer overflow (line %d)\n", in->line );
+    computeArithmetic( OP_MOD, l1, l2, &rem );
+    storeInt( frame + in->arg[ 0 ], ans );
+    storeInt( frame + in->arg[ 3 ], rem );
+    return;
+  }
+
+  if ( !computeArithmetic( in->op, l1, l2, &ans ) && run->code->checkOverflow )
+    runtimeError( run, "Integer overflow (line %d)\n", in->line );
+  storeInt( frame + in->arg[ 0 ], ans );
+}
+
+/**
+   Run one of the string instructions.
+   @param run the current run.
+   @param in the instruction to run.
+*/
+static void runString( Run *run, Instr const *in )
+{
+  Value *dest = run->frame + in->arg[ 0 ];
+  Value const *v1 = readSlot( run, in->arg[ 1 ], in->line );
+  Value const *v2, *v3;
+  switch ( in->op ) {
+  case OP_LENGTH:
+    lengthValue( dest, v1 );
+    return;
+  case OP_SUBSTR:
+    v2 = readSlot( run, in->arg[ 2 ], in->line );
+    v3 = readSlot( run, in->arg[ 3 ], in->line );
+    if ( !v2->numeric || !v3->numeric )
+      runtimeError( run, "Invalid number (line %d)\n", in->line );
+    substrValue( dest, v1, v2->num, v3->num );
+    return;
+  case OP_CONCAT:
+    v2 = readSlot( run, in->arg[ 2 ], in->line );
+    if ( !concatValues( dest, v1, v2 ) )
+      runtimeError( run, "String too long (line %d)\n", in->line );
+    return;
+  default:
+    v2 = readSlot( run, in->arg[ 2 ], in->line );
+    compareValues( dest, v1, v2 );
+    return;
+  }
+}
+
+/**
+   Return the target of a taken branch, stopping with an error message
+   if its label was never defined.
+   @param run the current run.
+   @param in the if or goto instruction.
+   @return index of the next instruction to run.
+*/
+static int jumpTarget( Run *run, Instr const *in )
+{
+  if ( in->target < 0 )
+    runtimeError( run, "Undefined label: %s (line %d)\n",
+                  run->frame[ in->arg[ 2 ] ].text.str, in->line );
+  return in->target;
+}
+
+/**
+   Return a timestamp for profiling, in CPU cycles where we can read
+   the cycle counter and in nanoseconds otherwise.
+   @return current timestamp.
+*/
+static unsigned long long readTimer()
+{
+#if defined( __x86_64__ ) || defined( __i386__ )
+  return __rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/**
+   Run one instruction.
+   @param run the current run.
+   @param in the instruction to run.
+   @param pc index of the instruction.
+   @return index of the next instruction to run.
+*/
+static inline int step( Run *run, Instr const *in, int pc )
+{
+  Value *frame = run->frame;
+  Value const *v;
+  switch ( in->op ) {
+  case OP_PRINT:
+    v = readSlot( run, in->arg[ 0 ], in->line );
+    if ( v->type == VAL_INT )
+      outputInt( run->out, v->num );
+    else {
+      int len;
+      char const *text = stringText( v, &len );
+      outputText( run->out, text, len );
+    }
+    return pc + 1;
+
+  case OP_SET:
+    copyValue( frame + in->arg[ 0 ], readSlot( run, in->arg[ 1 ], in->line ) );
+    return pc + 1;
+
+  case OP_IF:
+    v = readSlot( run, in->arg[ 0 ], in->line );
+    if ( v->numeric && v->num )
+      return jumpTarget( run, in );
+    return pc + 1;
+
+  case OP_GOTO:
+    return jumpTarget( run, in );
+
+  case OP_JEQ:
+  case OP_JLESS:
+    // A comparison fused with the if that tests it.  These are only
+    // made for labels that are defined.
+    runArithmetic( run, in );
+    return frame[ in->arg[ 0 ] ].numeric ? in->target : pc + 1;
+
+  case OP_CONCAT:
+  case OP_LENGTH:
+  case OP_SUBSTR:
+  case OP_COMPARE:
+    runString( run, in );
+    return pc + 1;
+
+  default:
+    runArithmetic( run, in );
+    return pc + 1;
+  }
+}
+
+/**
+   Run the loop starting at the given instruction once, recording the
+   path it takes, and make a trace for it.  The path has to come back
+   to the start without any other backward jump, and it can't be too
+   long.  If it doesn't, we give up on this loop for a while.
+   @param run the current run.
+   @param header index of the first instruction of the loop.
+   @return index of the next instruction to run.
+*/
+static int recordTrace( Run *run, int header )
+{
+  Instr const *instr = run->code->instr;
+  int count = run->code->count;
+  TraceStep steps[ MAX_TRACE ];
+  int n = 0;
+
+  int pc = header;
+  do {
+    int next = step( run, instr + pc, pc );
+    steps[ n ].pc = pc;
+    steps[ n ].next = next;
+    n++;
+    if ( next >= count || ( next <= pc && next != header ) ||
+         ( n == MAX_TRACE && next != header ) ) {
+      run->hot[ header ] = -BACKOFF;
+      return next;
+    }
+    pc = next;
+  } while ( pc != header );
+
+  run->traces[ header ] = compileTrace( run->code, run->frame, steps, n );
+  return header;
+}
+
+/**
+   Called for every backward jump.  If there's a trace for the loop
+   it's jumping to, this runs it, and if the loop has been run enough
+   times, this records a trace for it.
+   @param run the current run.
+   @param target index of the instruction the jump goes to.
+   @return index of the next instruction to run.
+*/
+static int loopBack( Run *run, int target )
+{
+  if ( !run->hot ) {
+    run->hot = (int *) calloc( run->code->count + 1, sizeof( int ) );
+    run->traces = (Trace **) calloc( run->code->count + 1, sizeof( Trace * ) );
+  }
+
+  Trace *trace = run->traces[ target ];
+  if ( trace ) {
+    int pc = runTrace( trace, run->out );
+    if ( traceIsUseless( trace ) ) {
+      freeTrace( trace );
+      run->traces[ target ] = NULL;
+      run->hot[ target ] = -BACKOFF;
+    }
+    return pc;
+  }
+
+  if ( ++run->hot[ target ] < HOT_LOOP )
+    return target;
+  return recordTrace( run, target );
+}
+
+/**
+   Run instructions until execution goes past the last one.  This is
+   called with prof either a null pointer or not, and it's inlined at
+   each call, so the copy that doesn't profile has all the profiling
+   code compiled out.  When we're profiling, loops aren't traced, so
+   every instruction is counted.
+   @param run the run, with its frame loaded.
+   @param prof counters to fill in, or NULL if we're not profiling.
+*/
+static inline void runLoop( Run *run, Profile *prof )
+{
+  Instr const *instr = run->code->instr;
+  int count = run->code->count;
+  bool trace = run->code->trace;
+
+  // Index of the current instruction.
+  int pc = 0;
+  while ( pc < count ) {
+    Instr const *in = instr + pc;
+    unsigned long long start = 0;
+    if ( prof ) {
+      prof->count[ pc ]++;
+      start = readTimer();
+    }
+
+    int next = step( run, in, pc );
+
+    if ( prof )
+      prof->cycles[ pc ] += readTimer() - start;
+    else if ( next <= pc && trace )
+      next = loopBack( run, next );
+    pc = next;
+  }
+}
+
+/**
+   Run a program, with or without profiling.  This is kept out of
+   runCode(), since the compiler can't optimize a function that calls
+   setjmp() as well as it can the interpreter loop.
+   @param run the run, with its frame loaded.
+   @param prof counters to fill in, or NULL if we're not profiling.
+*/
+static void __attribute__(( noinline )) runProgram( Run *run, Profile *prof )
+{
+  if ( prof )
+    runLoop( run, prof );
+  else
+    runLoop( run, NULL );
+}
+
+int runCode( Code const *code, char const *const *bindings, Output *out, FILE *err,
+             Profile *prof )
+{
+  Run run;
+  run.code = code;
+  run.out = out;
+  run.err = err;
+  run.hot = NULL;
+  run.traces = NULL;
+
+  // Values for all the variables and literals.
+  run.frame = (Value *) malloc( ( frameSize( code->vars ) + 1 ) * sizeof( Value ) );
+  loadFrame( code->vars, run.frame, bindings );
+
+  // A runtime error comes back here, with a status of 1.
+  int status = setjmp( run.fail );
+  if ( status == 0 )
+    runProgram( &run, prof );
+
+  if ( run.traces ) {
+    for ( int i = 0; i < code->count; i++ )
+      if ( run.traces[ i ] )
+        freeTrace( run.traces[ i ] );
+    free( run.traces );
+    free( run.hot );
+  }
+
+  // Let go of any strings the variables still hold.
+  for ( int i = 0; i < code->vars->varCount; i++ )
+    dropValue( run.frame + i );
+  free( run.frame );
+  flushOutput( out );
+  return status;
+}
@@ -0,0 +1,123 @@
+/**
+  @file bytecode.h
+  @author Prem Subedi
+  Compact instruction representation for a compiled script, and the
+  interpreter loop that runs it.
+*/
+
+#ifndef _BYTECODE_H_
+#define _BYTECODE_H_
+
+#include <stdio.h>
+#include "value.h"
+#include "output.h"
+
+/** Operation performed by a compiled instruction. */
+typedef enum {
+  OP_PRINT,
+  OP_SET,
+  OP_ADD,
+  OP_SUB,
+  OP_MULT,
+  OP_DIV,
+  OP_MOD,
+  OP_EQ,
+  OP_LESS,
+  OP_IF,
+  OP_GOTO,
+  OP_JEQ,
+  OP_JLESS,
+  OP_DIVMOD,
+  OP_CONCAT,
+  OP_LENGTH,
+  OP_SUBSTR,
+  OP_COMPARE
+} Opcode;
+
+/** A single compiled instruction.  Every kind of command compiles to
+    one of these, so the whole program is one flat array the
+    interpreter can walk without following pointers to commands. */
+typedef struct {
+  /** Operation this instruction performs. */
+  Opcode op;
+
+  /** Source file line for this instruction. Used for reporting errors. */
+  int line;
+
+  /** For if, goto and the fused compare-and-jumps, index of the
+      instruction to jump to, already resolved from the label.  This
+      is -1 if the label isn't defined. */
+  int target;
+
+  /** Operands, as indices of values in the frame (see VarTable).  For
+      arithmetic, these are the destination and the two sources.  For
+      if and goto, arg[ 2 ] is a literal holding the label name, so it
+      can be reported if it turns out to be undefined.  Only divmod
+      and substr use arg[ 3 ], for the destination of the remainder
+      and the number of characters to take. */
+  int arg[ 4 ];
+} Instr;
+
+/** A compiled program, the sequence of instructions to run. */
+typedef struct {
+  /** Array of all the instructions. */
+  Instr *instr;
+
+  /** Number of instructions in the array. */
+  int count;
+
+  /** Variables and literals the instructions refer to. */
+  VarTable const *vars;
+
+  /** True if arithmetic that overflows 64 bits should be reported as
+      an error, rather than wrapping around. */
+  bool checkOverflow;
+
+  /** True if hot loops should be recorded as traces and run without
+      going through the interpreter. */
+  bool trace;
+} Code;
+
+/** Counters the interpreter fills in when it's profiling a program,
+    one entry for each instruction. */
+typedef struct {
+  /** How many times each instruction ran. */
+  long *count;
+
+  /** Total time spent in each instruction, in CPU cycles where the
+      cycle counter is available, or nanoseconds otherwise. */
+  unsigned long long *cycles;
+} Profile;
+
+/** Compute the result of add, sub, mult, div or mod on two numbers.
+    A result that doesn't fit in 64 bits wraps around, the same as it
+    would in two's complement.  The divisor must not be zero.
+    @param op the operation, OP_ADD through OP_MOD.
+    @param l1 first operand.
+    @param l2 second operand.
+    @param ans storage for the result.
+    @return true if the result didn't overflow.
+*/
+bool computeArithmetic( Opcode op, int64_t l1, int64_t l2, int64_t *ans );
+
+/** Run the given compiled program from the start until execution
+    goes past the last instruction.  On a runtime error, this prints
+    an error message and stops the run.  Nothing is shared between
+    runs, so the same program can be run in more than one thread at
+    once.
+    @param code Compiled program to run.
+    @param bindings NULL-terminated list of NAME=value strings giving
+    the starting values of variables, or NULL to take them from the
+    environment.
+    @param out Output for the program.  This is flushed when the run
+    ends, and before an error message is printed.
+    @param err Stream for the error message if there's a runtime error.
+    @param prof Counters to fill in, with room for every instruction,
+    or NULL to run without profiling.
+    @return 0 if the program ran to the end, or 1 if it stopped with a
+    runtime error.
+*/
+int runCode( Code const *code, char const *const *bindings, Output *out, FILE *err,
+             Profile *prof );
+
+#endif
@@ -3,7 +3,8 @@
    @author Prem Subedi
    This provides the representation and supporting functions for implementing commands.
    It also contains the parser function for parsing individual commands
-   and creating objects to represent them.
+   and creating objects to represent them, and the functions that compile
+   each kind of command into a bytecode instruction.
  */
 
 #include <stdlib.h>
@@ -13,76 +14,42 @@
 #include "label.h"
 #include "parse.h"
 
-/**
-   This method copies the string from the given char pointer
-   to the one returned.
-   @param str constant char pointer (string).
-   @return copied string.
-*/
-static char *copyString( char const *str )
-{
-  char *cpy = (char *) malloc( strlen( str ) + 1 );
-  return strcpy( cpy, str );
-}
-
 /**
    Representation of struct PrintCommand, a sub class of command.
 */
 typedef struct {
 
-  int (*execute)( Command *cmd, LabelMap *labelMap, int pc );
-  int (*destroy)( Command *cmd);
+  void (*compile)( Command *cmd, Instr *instr, LabelMap *labelMap, VarTable const *vars );
   int lineNum;
-  char *arg;
+  int arg;
 } PrintCommand;
 
-/**
-   Function to free PrintCommand
-   @param cmd a command to be freed.
-*/
-static int destroyPrintCommand( Command *cmd ) {
-  PrintCommand *this = (PrintCommand *)cmd;
-  free( this->arg );
-  free( this );
-  return 0;
-}
-
-/** Pointer to a function to execute this command.
-   @param cmd The command to be executed.
+/** Function to compile this command.
+   @param cmd The command to be compiled.
+   @param instr Instruction to fill in for this command.
    @param labelMap Map for where all the labels are.
-   @param pc Index of the command being run (program counter), so
-   this command can return the index of the next command.
-   @return Index of the next instruction to run in the program (new
-   program counter).  
+   @param vars Table of variables and literals the operands refer to.
 */
-static int executePrint( Command *cmd, LabelMap *labelMap, int pc )
+static void compilePrint( Command *cmd, Instr *instr, LabelMap *labelMap, VarTable const *vars )
 {
-
   PrintCommand *this = (PrintCommand *)cmd;
-  if ( isVarName( this->arg ) ) {
-      if ( getenv(this->arg) == NULL ) {
-         fprintf(stderr, "Undefined variable: %s (line %d)\n", this->arg, this->lineNum );
-         exit( 1 );
-      }
-      printf( "%s", getenv(this->arg));
-  } else {
-      printf( "%s", this->arg + 1 );
-  }
-
-  return pc + 1;
+  instr->op = OP_PRINT;
+  instr->line = this->lineNum;
+  instr->arg[ 0 ] = operandSlot( vars, this->arg );
 }
 
 /**
    Constructs this command.
-   @param arg a constant char pointer, the only argument.
+   @param arena arena to allocate the command from.
+   @param line source line for the command.
+   @param arg operand code for the only argument.
 */
-static Command *makePrint( char const *arg )
+static Command *makePrint( Arena *arena, int line, int arg )
 {
-  PrintCommand *this = (PrintCommand *) malloc( sizeof( PrintCommand ) );
-  this->execute = executePrint;
-  this->destroy = destroyPrintCommand;
-  this->lineNum = getLineNumber();
-  this->arg = copyString( arg );
+  PrintCommand *this = (PrintCommand *) arenaAlloc( arena, sizeof( PrintCommand ) );
+  this->compile = compilePrint;
+  this->lineNum = line;
+  this->arg = arg;
   return (Command *) this;
 }
 
@@ -90,174 +57,191 @@ static Command *makePrint( char const *arg )
     Representation of struct SetCommand, a sub class of command.
 */
 typedef struct {
-  int (*execute)( Command *cmd, LabelMap *labelMap, int pc );
-  int (*destroy)( Command *cmd);
+  void (*compile)( Command *cmd, Instr *instr, LabelMap *labelMap, VarTable const *vars );
   int line;
-  char *arg1;
-  char *arg2;
+  int arg1;
+  int arg2;
 } SetCommand;
 
-/**
-   Function to free SetCommand
-   @param cmd a command to be freed.
-*/
-static int destroySetCommand( Command *cmd ) {
-  SetCommand *this = (SetCommand *)cmd;
-  free( this->arg1 );
-  free( this->arg2 );
-  free( this );
-  return 0;
-}
-
-/** Pointer to a function to execute this command.
-   @param cmd The command to be executed.
+/** Function to compile this command.
+   @param cmd The command to be compiled.
+   @param instr Instruction to fill in for this command.
    @param labelMap Map for where all the labels are.
-   @param pc Index of the command being run (program counter), so
-   this command can return the index of the next command.
-   @return Index of the next instruction to run in the program (new
-   program counter).
+   @param vars Table of variables and literals the operands refer to.
 */
-static int executeSet( Command *cmd, LabelMap *labelMap, int pc )
+static void compileSet( Command *cmd, Instr *instr, LabelMap *labelMap, VarTable const *vars )
 {
   SetCommand *this = (SetCommand *)cmd;
-  if ( isVarName( this->arg2 ) ) {
-    setenv( this->arg1, getenv( this->arg2 ), 1 );
-  } else {
-     setenv( this->arg1, this->arg2 + 1, 1 );
-  }
-
-  return pc + 1;
+  instr->op = OP_SET;
+  instr->line = this->line;
+  instr->arg[ 0 ] = this->arg1;
+  instr->arg[ 1 ] = operandSlot( vars, this->arg2 );
 }
 
 /**
    Constructs this command.
-   @param arg1 a variable
-   @param arg2 either a variable or literal
+   @param arena arena to allocate the command from.
+   @param line source line for the command.
+   @param arg1 slot of a variable
+   @param arg2 operand code for either a variable or literal
 */
-static Command *makeSet( char const *arg1, char const *arg2 )
+static Command *makeSet( Arena *arena, int line, int arg1, int arg2 )
 {
-  SetCommand *this = (SetCommand *) malloc( sizeof( SetCommand ) );
-  this->execute = executeSet;
-  this->destroy = destroySetCommand;
-  this->line = getLineNumber();
-  this->arg1 = copyString( arg1 );
-  this->arg2 = copyString( arg2 );
+  SetCommand *this = (SetCommand *) arenaAlloc( arena, sizeof( SetCommand ) );
+  this->compile = compileSet;
+  this->line = line;
+  this->arg1 = arg1;
+  this->arg2 = arg2;
   return (Command *) this;
 }
 
-/**
-   Enumerated type for Arithmetic operations involved in the command.
-*/
-typedef enum ArithmeticType { add, subtract, multiply, divide, mod, equal, less } Type;
-
 /**
    Representation of struct ArithmeticCommand, a sub class of command.
 */
 typedef struct {
-  int (*execute)( Command *cmd, LabelMap *labelMap, int pc );
-  int (*destroy)( Command *cmd);
+  void (*compile)( Command *cmd, Instr *instr, LabelMap *labelMap, VarTable const *vars );
   int line;
-  Type type;
-  char *dest;
-  char *arg1;
-  char *arg2;
+  Opcode type;
+  int dest;
+  int arg1;
+  int arg2;
 } ArithmeticCommand;
 
-/**
-   Function to free ArithmeticCommand
-   @param cmd a command to be freed.
+/** Function to compile this command.
+   @param cmd The command to be compiled.
+   @param instr Instruction to fill in for this command.
+   @param labelMap Map for where all the labels are.
+   @param vars Table of variables and literals the operands refer to.
 */
-static int destroyArithmeticCommand( Command *cmd ) {
+static void compileArithmetic( Command *cmd, Instr *instr, LabelMap *labelMap, VarTable const *vars )
+{
   ArithmeticCommand *this = (ArithmeticCommand *)cmd;
-  free( this->dest );
-  free( this->arg1 );
-  free( this->arg2 );
-  free( this );
-  return 0;
+  instr->op = this->type;
+  instr->line = this->line;
+  instr->arg[ 0 ] = this->dest;
+  instr->arg[ 1 ] = operandSlot( vars, this->arg1 );
+  instr->arg[ 2 ] = operandSlot( vars, this->arg2 );
 }
 
 /**
-   This method determines if the given char pointer is a variable or a 
-   literal and parses it accordingly. If is a variable, it extracts it's value 
-   using getenv().
-   @param str char pointer or an argument.
-   @i integer value
-   @return rlong the returned literal or the variable 
-
+    I got help for this method from TA Joy in his office hours on Monday (November 27).
 */
-static long valOfVar( char *str, int *i )
+static Command *makeArithmetic( Arena *arena, int line, Opcode type,
+                                 int dest, int arg1, int arg2 )
 {
-  long rlong = 0;
-  int numOfMatches;
-  if ( isVarName( str ) ) {
-    numOfMatches = sscanf(  getenv( str ), "%ld", &rlong ); 
-  } else {
-    numOfMatches = sscanf( str + 1, "%ld", &rlong );
-  }
-  if ( i && numOfMatches != 1 ) (*i)++;
-  return rlong;
+
+  ArithmeticCommand *this = (ArithmeticCommand *) arenaAlloc( arena, sizeof( ArithmeticCommand ) );
+
+  this->compile = compileArithmetic;
+  this->line = line;
+  this->type = type;
+  this->dest = dest;
+  this->arg1 = arg1;
+  this->arg2 = arg2;
+  return (Command *) this;
 }
 
-/** Pointer to a function to execute this command.
-   @param cmd The command to be executed.
+/**
+    Representation of struct DivModCommand, a sub class of command.
+    It stores both the quotient and the remainder of one division.
+*/
+typedef struct {
+  void (*compile)( Command *cmd, Instr *instr, LabelMap *labelMap, VarTable const *vars );
+  int line;
+  int quot;
+  int rem;
+  int arg1;
+  int arg2;
+} DivModCommand;
+
+/** Function to compile this command.
+   @param cmd The command to be compiled.
+   @param instr Instruction to fill in for this command.
    @param labelMap Map for where all the labels are.
-   @param pc Index of the command being run (program counter), so
-   this command can return the index of the next command.
-   @return Index of the next instruction to run in the program (new
-   program counter).
+   @param vars Table of variables and literals the operands refer to.
 */
-static int executeArithmetic( Command *cmd, LabelMap *labelMap, int pc )
+static void compileDivMod( Command *cmd, Instr *instr, LabelMap *labelMap, VarTable const *vars )
 {
-  ArithmeticCommand *this = (ArithmeticCommand *)cmd;
-  long ans;
-  int i = 0;
-  char *buffer[ 30 ];
-  int l1 = valOfVar( this->arg1, &i );
-  int l2 = valOfVar( this->arg2, &i );
-  if ( i != 0 ) {
-    fprintf( stderr, "Invalid number (line %d)\n", this->line );
-    exit( 1 );
-  }
-
-  if (this->type == add ) ans = l1 + l2;
-  else if (this->type == subtract ) ans = l1 - l2;
-  else if (this->type == multiply ) ans = l1 * l2;
-  else if (this->type == divide ) {
-     if ( l2 == 0) {
-         fprintf( stderr, "Divide by zero (line %d)\n", this->line );
-         exit( 1 );
-       }
-     ans = l1 / l2;
-  } else if (this->type == mod ) ans = l1 % l2;
-  else if (this->type == equal ) ans = l1 == l2;
-  else if (this->type == less ) ans = l1 < l2;
-  else printf("Invalid command\n");
-  
- 
-  if ( this->type != less && this->type != equal ) sprintf( buffer, "%ld", ans );
-  else {
-     if ( ans ) sprintf( buffer, "%s", "1");
-     else sprintf( buffer, "%s", "");
-  }
-  setenv( this->dest, (const char *) buffer, 1 );
-  return pc + 1;
+  DivModCommand *this = (DivModCommand *)cmd;
+  instr->op = OP_DIVMOD;
+  instr->line = this->line;
+  instr->arg[ 0 ] = this->quot;
+  instr->arg[ 1 ] = operandSlot( vars, this->arg1 );
+  instr->arg[ 2 ] = operandSlot( vars, this->arg2 );
+  instr->arg[ 3 ] = this->rem;
 }
 
 /**
-    I got help for this method from TA Joy in his office hours on Monday (November 27).
+   Constructs this command.
+   @param arena arena to allocate the command from.
+   @param line source line for the command.
+   @param quot slot of the variable for the quotient.
+   @param rem slot of the variable for the remainder.
+   @param arg1 operand code for the dividend.
+   @param arg2 operand code for the divisor.
 */
-static Command *makeArithmetic( Type type, char const *dest, char const *arg1, char const *arg2 )
+static Command *makeDivMod( Arena *arena, int line, int quot, int rem, int arg1, int arg2 )
 {
+  DivModCommand *this = (DivModCommand *) arenaAlloc( arena, sizeof( DivModCommand ) );
+  this->compile = compileDivMod;
+  this->line = line;
+  this->quot = quot;
+  this->rem = rem;
+  this->arg1 = arg1;
+  this->arg2 = arg2;
+  return (Command *) this;
+}
 
-  ArithmeticCommand *this = (ArithmeticCommand *) malloc( sizeof( ArithmeticCommand ) );
+/**
+    Representation of struct StringCommand, a sub class of command.
+    It's used for all the commands that work on text, which take from
+    one to three operands.
+*/
+typedef struct {
+  void (*compile)( Command *cmd, Instr *instr, LabelMap *labelMap, VarTable const *vars );
+  int line;
+  Opcode type;
+  int dest;
+  int nargs;
+  int arg[ 3 ];
+} StringCommand;
+
+/** Function to compile this command.
+   @param cmd The command to be compiled.
+   @param instr Instruction to fill in for this command.
+   @param labelMap Map for where all the labels are.
+   @param vars Table of variables and literals the operands refer to.
+*/
+static void compileString( Command *cmd, Instr *instr, LabelMap *labelMap, VarTable const *vars )
+{
+  StringCommand *this = (StringCommand *)cmd;
+  instr->op = this->type;
+  instr->line = this->line;
+  instr->arg[ 0 ] = this->dest;
+  for ( int i = 0; i < this->nargs; i++ )
+    instr->arg[ i + 1 ] = operandSlot( vars, this->arg[ i ] );
+}
 
-  this->execute = executeArithmetic;
-  this->destroy = destroyArithmeticCommand;
-  this->line = getLineNumber();
+/**
+   Constructs this command.
+   @param arena arena to allocate the command from.
+   @param line source line for the command.
+   @param type opcode for the command.
+   @param dest slot of the variable for the result.
+   @param nargs number of operands.
+   @param arg operand codes for the operands.
+*/
+static Command *makeString( Arena *arena, int line, Opcode type, int dest,
+                            int nargs, int const *arg )
+{
+  StringCommand *this = (StringCommand *) arenaAlloc( arena, sizeof( StringCommand ) );
+  this->compile = compileString;
+  this->line = line;
   this->type = type;
-  this->dest = copyString( dest );
-  this->arg1 = copyString( arg1 );
-  this->arg2 = copyString( arg2 );
+  this->dest = dest;
+  this->nargs = nargs;
+  for ( int i = 0; i < nargs; i++ )
+    this->arg[ i ] = arg[ i ];
   return (Command *) this;
 }
 
@@ -266,48 +250,37 @@ static Command *makeArithmetic( Type type, char const *dest, char const *arg1, c
 */
 typedef struct {
 
-  int (*execute)( Command *cmd, LabelMap *labelMap, int pc );
-  int (*destroy)( Command *cmd);
+  void (*compile)( Command *cmd, Instr *instr, LabelMap *labelMap, VarTable const *vars );
   int line;
-  char *condition;
-  char *label;
+  int condition;
+  int label;
 } IfCommand;
 
-/** Pointer to a function to execute this command.
-   @param cmd The command to be executed.
+/** Function to compile this command.  The label is looked up here,
+   once, so the instruction can jump straight to its target.
+   @param cmd The command to be compiled.
+   @param instr Instruction to fill in for this command.
    @param labelMap Map for where all the labels are.
-   @param pc Index of the command being run (program counter), so
-   this command can return the index of the next command.
-   @return Index of the next instruction to run in the program (new
-   program counter).
+   @param vars Table of variables and literals the operands refer to.
 */
-static int executeIf( Command *cmd, LabelMap *labelMap, int pc )
+static void compileIf( Command *cmd, Instr *instr, LabelMap *labelMap, VarTable const *vars )
 {
   IfCommand *this = (IfCommand *)cmd;
-  if ( valOfVar( this->condition, NULL ) ) return findLabel( labelMap, this->label );
-  else return pc + 1;
+  instr->op = OP_IF;
+  instr->line = this->line;
+  instr->target = findLabel( labelMap, (char *) operandText( vars, this->label ) );
+  instr->arg[ 0 ] = operandSlot( vars, this->condition );
+  instr->arg[ 2 ] = operandSlot( vars, this->label );
 }
 
-/**
-   Function to free IfCommand
-   @param cmd a command to be freed.
-*/
-static int destroyIf( Command *cmd )
+static Command *makeIf( Arena *arena, int line, int condition, int label )
 {
-  IfCommand *this = (IfCommand *)cmd;
-  free( this );
-  return 0;
-}
 
-static Command *makeIf( char const *condition, char const *label )
-{
-
-  IfCommand *this = (IfCommand *) malloc( sizeof( IfCommand ) );
-  this->execute = executeIf;
-  this->destroy = destroyIf;
-  this->line = getLineNumber();
-  this->condition = copyString( condition );
-  this->label = copyString( label );
+  IfCommand *this = (IfCommand *) arenaAlloc( arena, sizeof( IfCommand ) );
+  this->compile = compileIf;
+  this->line = line;
+  this->condition = condition;
+  this->label = label;
   return (Command *) this;
 }
 
@@ -316,101 +289,157 @@ static Command *makeIf( char const *condition, char const *label )
 */
 typedef struct {
 
-  int (*execute)( Command *cmd, LabelMap *labelMap, int pc );
-  int (*destroy)( Command *cmd);
+  void (*compile)( Command *cmd, Instr *instr, LabelMap *labelMap, VarTable const *vars );
   int line;
-  char *label;
+  int label;
 } GotoCommand;
 
-/**
-   Function to free Goto Command
-   @param cmd a command to be freed.
+/** Function to compile this command.  The label is looked up here,
+   once, so the instruction can jump straight to its target.
+   @param cmd The command to be compiled.
+   @param instr Instruction to fill in for this command.
+   @param labelMap Map for where all the labels are.
+   @param vars Table of variables and literals the operands refer to.
 */
-static int destroyGoto( Command *cmd )
+static void compileGoto( Command *cmd, Instr *instr, LabelMap *labelMap, VarTable const *vars )
 {
   GotoCommand *this = (GotoCommand *)cmd;
-  free( this );
-  return 0;
+  instr->op = OP_GOTO;
+  instr->line = this->line;
+  instr->target = findLabel( labelMap, (char *) operandText( vars, this->label ) );
+  instr->arg[ 2 ] = operandSlot( vars, this->label );
 }
 
-/** Pointer to a function to execute this command.
-   @param cmd The command to be executed.
-   @param labelMap Map for where all the labels are.
-   @param pc Index of the command being run (program counter), so
-   this command can return the index of the next command.
-   @return Index of the next instruction to run in the program (new
-   program counter).
+static Command *makeGoto( Arena *arena, int line, int label )
+{
+  GotoCommand *this = (GotoCommand *) arenaAlloc( arena, sizeof( GotoCommand ) );
+  this->compile = compileGoto;
+  this->line = line;
+  this->label = label;
+  return (Command *) this;
+}
+
+/**
+   Intern a token as a variable or literal operand.
+   @param vars table to add the operand to.
+   @param src source the token came from.
+   @param tok the token.
+   @return operand code for the token.
 */
-static int executeGoto( Command *cmd, LabelMap *labelMap, int pc )
+static int operand( VarTable *vars, Source const *src, Token tok )
 {
-  GotoCommand *this = (GotoCommand *)cmd;
-  return findLabel( labelMap, this->label );
+  return internOperand( vars, tokenText( src, tok ), tok.length );
 }
 
-static Command *makeGoto( char const *label )
+/**
+   Intern a label name as a literal.  This keeps the name around for
+   resolving the label at compile time, and for reporting a jump to an
+   undefined label at run time.
+   @param vars table to add the literal to.
+   @param src source the token came from.
+   @param tok token for the name of the label.
+   @return operand code for the literal.
+*/
+static int labelOperand( VarTable *vars, Source const *src, Token tok )
 {
-  GotoCommand *this = (GotoCommand *) malloc( sizeof( GotoCommand ) );
-  this->execute = executeGoto;
-  this->destroy = destroyGoto;
-  this->line = getLineNumber();
-  this->label = copyString( label );
-  return (Command *) this;
+  return internLiteral( vars, tokenText( src, tok ), tok.length );
 }
 
 /**
-   This method parses the given command and calls the appropriate functions 
+   This method parses the given command and calls the appropriate functions
    for the necessary operations.
    I received help for this from TA Joy in his office hours,
    we discussed about enumerated types.
-   @param cmdName a char pointer for command name
-   @param fp a pointer to the given file.
+   @param cmdName token for the command name
+   @param src source the command is read from.
+   @param vars table for interning the variables and literals the command uses.
+   @param arena arena to allocate the command from.
 */
-Command *parseCommand( char *cmdName, FILE *fp )
+Command *parseCommand( Token cmdName, Source *src, VarTable *vars, Arena *arena )
 {
 
-  char dest[ MAX_VARNAME + 1 ];
-  char arg1[ MAX_TOKEN + 1 ];
-  char arg2[ MAX_TOKEN + 1 ];
-
-  if ( strcmp( cmdName, "print" ) == 0 ) {
-    expectToken( dest, fp );
-    requireToken( ";", fp );
-    return makePrint( dest );
-
-  } else if ( strcmp( cmdName, "goto" ) == 0 ) {
-    expectToken( dest, fp );
-    requireToken( ";", fp );
-    return makeGoto( dest );
-
-  } else if ( strcmp( cmdName, "if" ) == 0 ) {
-    expectToken( dest, fp );
-    expectToken( arg1, fp );
-    requireToken( ";", fp );
-    return makeIf( dest, arg1 );
-
-  } else if ( strcmp( cmdName, "set" ) == 0 ) {
-    expectToken( dest, fp );
-    expectToken( arg1, fp );
-    requireToken( ";", fp );
-    return makeSet( dest, arg1 );
+  Token dest, rem, arg1, arg2;
+
+  if ( tokenIs( src, cmdName, "print" ) ) {
+    expectToken( src, &dest );
+    requireToken( src, ";" );
+    return makePrint( arena, getLineNumber( src ), operand( vars, src, dest ) );
+
+  } else if ( tokenIs( src, cmdName, "goto" ) ) {
+    expectToken( src, &dest );
+    requireToken( src, ";" );
+    return makeGoto( arena, getLineNumber( src ), labelOperand( vars, src, dest ) );
+
+  } else if ( tokenIs( src, cmdName, "if" ) ) {
+    expectToken( src, &dest );
+    expectToken( src, &arg1 );
+    requireToken( src, ";" );
+    return makeIf( arena, getLineNumber( src ), operand( vars, src, dest ),
+                   labelOperand( vars, src, arg1 ) );
+
+  } else if ( tokenIs( src, cmdName, "set" ) ) {
+    expectToken( src, &dest );
+    expectToken( src, &arg1 );
+    requireToken( src, ";" );
+    return makeSet( arena, getLineNumber( src ),
+                    internVar( vars, tokenText( src, dest ), dest.length ),
+                    operand( vars, src, arg1 ) );
+
+  } else if ( tokenIs( src, cmdName, "divmod" ) ) {
+    expectToken( src, &dest );
+    expectToken( src, &rem );
+    expectToken( src, &arg1 );
+    expectToken( src, &arg2 );
+    requireToken( src, ";" );
+    return makeDivMod( arena, getLineNumber( src ),
+                       internVar( vars, tokenText( src, dest ), dest.length ),
+                       internVar( vars, tokenText( src, rem ), rem.length ),
+                       operand( vars, src, arg1 ), operand( vars, src, arg2 ) );
+
+  } else if ( tokenIs( src, cmdName, "concat" ) || tokenIs( src, cmdName, "length" ) ||
+              tokenIs( src, cmdName, "substr" ) || tokenIs( src, cmdName, "compare" ) ) {
+    // Length takes one operand, substr takes three, the others two.
+    Opcode tp = OP_CONCAT;
+    int nargs = 2;
+    if ( tokenIs( src, cmdName, "length" ) ) {
+      tp = OP_LENGTH;
+      nargs = 1;
+    } else if ( tokenIs( src, cmdName, "substr" ) ) {
+      tp = OP_SUBSTR;
+      nargs = 3;
+    } else if ( tokenIs( src, cmdName, "compare" ) )
+      tp = OP_COMPARE;
+
+    Token args[ 3 ];
+    int arg[ 3 ];
+    expectToken( src, &dest );
+    for ( int i = 0; i < nargs; i++ )
+      expectToken( src, args + i );
+    requireToken( src, ";" );
+    for ( int i = 0; i < nargs; i++ )
+      arg[ i ] = operand( vars, src, args[ i ] );
+    return makeString( arena, getLineNumber( src ), tp,
+                       internVar( vars, tokenText( src, dest ), dest.length ), nargs, arg );
 
   } else {
-    Type tp;
-    
-    if ( strcmp( cmdName, "add" ) == 0 ) tp = add;
-    else if ( strcmp( cmdName, "sub" ) == 0 ) tp = subtract;
-    else if ( strcmp( cmdName, "mult" ) == 0 ) tp = multiply;
-    else if ( strcmp( cmdName, "div" ) == 0 ) tp = divide;
-    else if ( strcmp( cmdName, "mod" ) == 0 ) tp = mod;
-    else if ( strcmp( cmdName, "eq" ) == 0 ) tp = equal;
-    else if ( strcmp( cmdName, "less" ) == 0 ) tp = less;
-    else syntaxError();
-    
-    expectToken( dest, fp );
-    expectToken( arg1, fp );
-    expectToken( arg2, fp );
-    requireToken( ";", fp );
-    return makeArithmetic( tp, dest, arg1, arg2 );    
+    Opcode tp = OP_ADD;
+
+    if ( tokenIs( src, cmdName, "add" ) ) tp = OP_ADD;
+    else if ( tokenIs( src, cmdName, "sub" ) ) tp = OP_SUB;
+    else if ( tokenIs( src, cmdName, "mult" ) ) tp = OP_MULT;
+    else if ( tokenIs( src, cmdName, "div" ) ) tp = OP_DIV;
+    else if ( tokenIs( src, cmdName, "mod" ) ) tp = OP_MOD;
+    else if ( tokenIs( src, cmdName, "eq" ) ) tp = OP_EQ;
+    else if ( tokenIs( src, cmdName, "less" ) ) tp = OP_LESS;
+    else syntaxError( src );
+
+    expectToken( src, &dest );
+    expectToken( src, &arg1 );
+    expectToken( src, &arg2 );
+    requireToken( src, ";" );
+    return makeArithmetic( arena, getLineNumber( src ), tp,
+                           internVar( vars, tokenText( src, dest ), dest.length ),
+                           operand( vars, src, arg1 ), operand( vars, src, arg2 ) );
   }
   return NULL;
 }
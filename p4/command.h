@@ -9,6 +9,9 @@
 
 #include <stdio.h>
 #include "label.h"
+#include "bytecode.h"
+#include "parse.h"
+#include "arena.h"
 
 /** It's weird, but you can give a short name to a struct before you define it.
     Then, you can use the short name in the definition. */
@@ -20,33 +23,30 @@ typedef struct CommandStruct Command;
     by the subclass will be added after these common fields.
 */
 struct CommandStruct {
-  /** Pointer to a function to execute this command.
-      @param cmd The command to be executed.
+  /** Pointer to a function to compile this command into a bytecode
+      instruction.  Any label the command refers to is resolved here,
+      so running the instruction never has to look it up.
+      @param cmd The command to be compiled.
+      @param instr Instruction to fill in for this command.
       @param labelMap Map for where all the labels are.
-      @param pc Index of the command being run (program counter), so
-      this command can return the index of the next command.
-      @return Index of the next instruction to run in the program (new
-      program counter).  Normally, this will just be one greater than
-      the pc input, but on a branch, the program could jump to
-      anywhere.
+      @param vars Table of variables and literals the operands refer to.
    */
-  int (*execute)( Command *cmd, LabelMap *labelMap, int pc );
-  
-  /**
-   Function to free the given Command
-   @param cmd a command to be freed.
-*/
-  int (*destroy)( Command *cmd);
+  void (*compile)( Command *cmd, Instr *instr, LabelMap *labelMap, VarTable const *vars );
 
   /** Source file line containing this command. Used for reporting errors. */
   int line;
 };
 
 /** Parse the next command from the given input stream and return a
-    pointer to Command object to represent it.
-    @param fp stream to parse the command from.
+    pointer to Command object to represent it.  The command is
+    allocated from the given arena, so there's nothing to free for
+    it individually.
+    @param cmdName token for the name of the command, already read from the input.
+    @param src source to parse the command from.
+    @param vars table for interning the variables and literals the command uses.
+    @param arena arena to allocate the command from.
     @return the Command object constructed from the input.
 */
-Command *parseCommand( char *cmdName, FILE *fp );
+Command *parseCommand( Token cmdName, Source *src, VarTable *vars, Arena *arena );
 
 #endif
@@ -0,0 +1,313 @@
+/**
+   @file image.c
+   @author Prem Subedi
+   This component saves compiled programs as binary images and loads
+   them again.  An image holds everything needed to run a program, the
+   instructions, the names of the variables, the literals and the
+   labels, laid out so it can be mapped into memory and used in place.
+   Images are only good on the kind of machine that wrote them.
+ */
+
+#include "program.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "parse.h"
+
+/** Identifies a nonde image file. */
+#define IMAGE_MAGIC "NONDEIMG"
+
+/** Version of the image layout.  This changes whenever the layout or
+    the instruction set does. */
+#define IMAGE_VERSION 1
+
+/** Number of opcodes, for checking instructions in an image. */
+#define OPCODES ( OP_COMPARE + 1 )
+
+/** Start of an image file.  The sections follow it in this order:
+    instructions, the source line of each command, offsets of the
+    variable names and the literals in the text, labels, then the text
+    of all the names and literals, each null terminated. */
+typedef struct {
+  /** IMAGE_MAGIC, without its null terminator. */
+  char magic[ 8 ];
+
+  /** IMAGE_VERSION. */
+  uint32_t version;
+
+  /** Whether the program was optimized, NONDE_OPTIMIZE or 0. */
+  uint32_t flags;
+
+  /** Hash of the script the image was made from. */
+  uint64_t sourceHash;
+
+  /** Number of commands, instructions, variables, literals and labels. */
+  int32_t cmdCount;
+  int32_t instrCount;
+  int32_t varCount;
+  int32_t constCount;
+  int32_t labelCount;
+
+  /** Number of bytes of text. */
+  int32_t textSize;
+} ImageHeader;
+
+/** A label in an image. */
+typedef struct {
+  /** Offset of its name in the text. */
+  int32_t name;
+
+  /** Index of the command it labels. */
+  int32_t index;
+} ImageLabel;
+
+/** Pointers to the sections of an image. */
+typedef struct {
+  Instr *instr;
+  int32_t *cmdLine;
+  int32_t *names;
+  int32_t *consts;
+  ImageLabel *labels;
+  char *text;
+
+  /** Total size of the image. */
+  uint64_t size;
+} Sections;
+
+/**
+   Work out where each section of an image goes, from the counts in
+   its header.
+   @param hdr header of the image.
+   @param sec sections to fill in.
+*/
+static void findSections( ImageHeader const *hdr, Sections *sec )
+{
+  // Sizes are added up in 64 bits, so a damaged header can't overflow.
+  char *base = (char *) hdr;
+  uint64_t pos = sizeof( ImageHeader );
+  sec->instr = (Instr *) ( base + pos );
+  pos += (uint64_t) hdr->instrCount * sizeof( Instr );
+  sec->cmdLine = (int32_t *) ( base + pos );
+  pos += (uint64_t) hdr->cmdCount * sizeof( int32_t );
+  sec->names = (int32_t *) ( base + pos );
+  pos += (uint64_t) hdr->varCount * sizeof( int32_t );
+  sec->consts = (int32_t *) ( base + pos );
+  pos += (uint64_t) hdr->constCount * sizeof( int32_t );
+  sec->labels = (ImageLabel *) ( base + pos );
+  pos += (uint64_t) hdr->labelCount * sizeof( ImageLabel );
+  sec->text = base + pos;
+  sec->size = pos + hdr->textSize;
+}
+
+uint64_t hashSource( char const *text, long len )
+{
+  // 64-bit FNV-1a.
+  uint64_t h = 14695981039346656037ULL;
+  for ( long i = 0; i < len; i++ ) {
+    h ^= (unsigned char) text[ i ];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+int nondeSaveImage( NondeProgram const *prog, char const *path )
+{
+  VarTable const *vars = &prog->vars;
+  LabelMap const *map = &prog->labelMap;
+  ImageHeader hdr;
+  memcpy( hdr.magic, IMAGE_MAGIC, sizeof( hdr.magic ) );
+  hdr.version = IMAGE_VERSION;
+  hdr.flags = prog->flags & NONDE_OPTIMIZE;
+  hdr.sourceHash = prog->sourceHash;
+  hdr.cmdCount = prog->count;
+  hdr.instrCount = prog->code.count;
+  hdr.varCount = vars->varCount;
+  hdr.constCount = vars->constCount;
+  hdr.labelCount = map->size;
+
+  // The text holds the variable names, then the literals, then the labels.
+  long textSize = 0;
+  for ( int i = 0; i < vars->varCount; i++ )
+    textSize += strlen( vars->names[ i ] ) + 1;
+  for ( int i = 0; i < vars->constCount; i++ )
+    textSize += strlen( vars->consts[ i ] ) + 1;
+  textSize += map->namesLen;
+
+  // There's always a null at the end, even if there's no other text.
+  hdr.textSize = textSize + 1;
+
+  // Build the whole image in memory, then write it all at once.
+  Sections sec;
+  findSections( &hdr, &sec );
+  char *image = (char *) calloc( sec.size, 1 );
+  memcpy( image, &hdr, sizeof( hdr ) );
+  findSections( (ImageHeader *) image, &sec );
+
+  memcpy( sec.instr, prog->code.instr, prog->code.count * sizeof( Instr ) );
+  for ( int i = 0; i < prog->count; i++ )
+    sec.cmdLine[ i ] = prog->cmdLine ? prog->cmdLine[ i ] : prog->cmd[ i ]->line;
+
+  int pos = 0;
+  for ( int i = 0; i < vars->varCount; i++ ) {
+    sec.names[ i ] = pos;
+    strcpy( sec.text + pos, vars->names[ i ] );
+    pos += strlen( vars->names[ i ] ) + 1;
+  }
+  for ( int i = 0; i < vars->constCount; i++ ) {
+    sec.consts[ i ] = pos;
+    strcpy( sec.text + pos, vars->consts[ i ] );
+    pos += strlen( vars->consts[ i ] ) + 1;
+  }
+  memcpy( sec.text + pos, map->names, map->namesLen );
+  int n = 0;
+  for ( int i = 0; i < map->capacity; i++ )
+    if ( map->labels[ i ].name >= 0 ) {
+      sec.labels[ n ].name = pos + map->labels[ i ].name;
+      sec.labels[ n ].index = map->labels[ i ].lineNum;
+      n++;
+    }
+
+  // Write to a temporary file first, and rename it into place.
+  int len = strlen( path );
+  char *tmp = (char *) malloc( len + 32 );
+  sprintf( tmp, "%s.%ld.tmp", path, (long) getpid() );
+  FILE *fp = fopen( tmp, "wb" );
+  int status = -1;
+  if ( fp ) {
+    bool ok = fwrite( image, 1, sec.size, fp ) == sec.size;
+    if ( fclose( fp ) == 0 && ok && rename( tmp, path ) == 0 )
+      status = 0;
+    else
+      remove( tmp );
+  }
+
+  free( tmp );
+  free( image );
+  return status;
+}
+
+/**
+   Check that an image is for the given script, and that nothing in it
+   points outside of it, so a damaged image can't crash the program.
+   @param hdr header of the mapped image.
+   @param size size of the image file.
+   @param hash hash of the script.
+   @param flags flags the program is being loaded with.
+   @return true if the image can be used.
+*/
+static bool checkImage( ImageHeader const *hdr, uint64_t size, uint64_t hash, int flags )
+{
+  if ( size < sizeof( ImageHeader ) || memcmp( hdr->magic, IMAGE_MAGIC, sizeof( hdr->magic ) ) ||
+       hdr->version != IMAGE_VERSION || hdr->flags != ( flags & NONDE_OPTIMIZE ) ||
+       hdr->sourceHash != hash )
+    return false;
+  if ( hdr->cmdCount < 0 || hdr->instrCount < 0 || hdr->varCount < 0 ||
+       hdr->constCount < 0 || hdr->labelCount < 0 || hdr->textSize <= 0 )
+    return false;
+
+  Sections sec;
+  findSections( hdr, &sec );
+  if ( sec.size != size || sec.text[ hdr->textSize - 1 ] != '\0' )
+    return false;
+
+  // Every operand has to be a slot in the frame, which always has room
+  // for at least one value.  Only if and goto check for an undefined
+  // label, so the fused compare-and-jumps need a real target.  The
+  // error for an undefined label prints its name, so that has to be a
+  // literal, which is always set.
+  int slots = hdr->varCount + hdr->constCount;
+  for ( int i = 0; i < hdr->instrCount; i++ ) {
+    Instr const *in = sec.instr + i;
+    if ( in->op < 0 || in->op >= OPCODES || in->target < -1 || in->target > hdr->instrCount )
+      return false;
+    if ( ( in->op == OP_JEQ || in->op == OP_JLESS ) && in->target < 0 )
+      return false;
+    if ( ( in->op == OP_IF || in->op == OP_GOTO ) && in->target < 0 &&
+         in->arg[ 2 ] < hdr->varCount )
+      return false;
+    for ( int j = 0; j < 4; j++ )
+      if ( in->arg[ j ] < 0 || ( in->arg[ j ] >= slots && in->arg[ j ] != 0 ) )
+        return false;
+  }
+
+  for ( int i = 0; i < hdr->varCount; i++ )
+    if ( sec.names[ i ] < 0 || sec.names[ i ] >= hdr->textSize )
+      return false;
+  for ( int i = 0; i < hdr->constCount; i++ )
+    if ( sec.consts[ i ] < 0 || sec.consts[ i ] >= hdr->textSize )
+      return false;
+  for ( int i = 0; i < hdr->labelCount; i++ )
+    if ( sec.labels[ i ].name < 0 || sec.labels[ i ].name >= hdr->textSize ||
+         sec.labels[ i ].index < 0 || sec.labels[ i ].index > hdr->cmdCount )
+      return false;
+  return true;
+}
+
+NondeProgram *nondeLoadImage( char const *path, FILE *source, int flags )
+{
+  // Hash the script, to see if the image is still good.
+  Source src;
+  if ( !openSource( &src, source ) ) {
+    closeSource( &src );
+    return NULL;
+  }
+  uint64_t hash = hashSource( src.text, src.length );
+  closeSource( &src );
+
+  int fd = open( path, O_RDONLY );
+  if ( fd < 0 )
+    return NULL;
+  struct stat st;
+  void *image = MAP_FAILED;
+  if ( fstat( fd, &st ) == 0 && st.st_size >= (off_t) sizeof( ImageHeader ) )
+    image = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+  close( fd );
+  if ( image == MAP_FAILED )
+    return NULL;
+
+  ImageHeader const *hdr = (ImageHeader const *) image;
+  if ( !checkImage( hdr, st.st_size, hash, flags ) ) {
+    munmap( image, st.st_size );
+    return NULL;
+  }
+  Sections sec;
+  findSections( hdr, &sec );
+
+  // Everything points into the image, except the lists of names and
+  // literals, and the label map.
+  NondeProgram *prog = (NondeProgram *) malloc( sizeof( NondeProgram ) );
+  prog->cmd = NULL;
+  prog->count = prog->cap = hdr->cmdCount;
+  prog->cmdLine = sec.cmdLine;
+  prog->image = image;
+  prog->imageSize = st.st_size;
+  prog->flags = flags;
+  prog->sourceHash = hash;
+  initArena( &prog->arena );
+  initVars( &prog->vars, &prog->arena );
+
+  VarTable *vars = &prog->vars;
+  vars->varCount = vars->varCap = hdr->varCount;
+  vars->constCount = vars->constCap = hdr->constCount;
+  vars->names = (char **) realloc( vars->names, ( hdr->varCount + 1 ) * sizeof( char * ) );
+  vars->consts = (char **) realloc( vars->consts, ( hdr->constCount + 1 ) * sizeof( char * ) );
+  for ( int i = 0; i < hdr->varCount; i++ )
+    vars->names[ i ] = sec.text + sec.names[ i ];
+  for ( int i = 0; i < hdr->constCount; i++ )
+    vars->consts[ i ] = sec.text + sec.consts[ i ];
+
+  initMap( &prog->labelMap );
+  for ( int i = 0; i < hdr->labelCount; i++ )
+    addLabel( &prog->labelMap, sec.text + sec.labels[ i ].name, sec.labels[ i ].index );
+
+  Code *code = &prog->code;
+  code->instr = sec.instr;
+  code->count = hdr->instrCount;
+  code->vars = vars;
+  code->checkOverflow = ( flags & NONDE_CHECK_OVERFLOW ) != 0;
+  code->trace = ( flags & NONDE_NO_TRACE ) == 0;
+  return prog;
+}
@@ -9,7 +9,72 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
-#define CAPACITY 5
+
+/** Initial number of slots in the hash table, a power of two. */
+#define CAPACITY 16
+
+/** Initial capacity of the name storage. */
+#define NAMES_CAPACITY 256
+
+/**
+   Compute the FNV-1a hash of a name.
+   @param name the name to hash.
+   @param len number of characters in the name.
+   @return hash code for the name.
+*/
+static unsigned int hashName( char const *name, int len )
+{
+  unsigned int h = 2166136261u;
+  for ( int i = 0; i < len; i++ ) {
+    h ^= (unsigned char) name[ i ];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+/**
+   Return the slot holding the given name, or the empty slot where it
+   would go if it's not in the map.
+   @param lmap map to search.
+   @param name name to look for.
+   @param len number of characters in the name.
+   @param hash hash of the name.
+   @return pointer to the slot.
+*/
+static Label *probe( LabelMap *lmap, char const *name, int len, unsigned int hash )
+{
+  unsigned int mask = lmap->capacity - 1;
+  for ( unsigned int i = hash & mask; ; i = ( i + 1 ) & mask ) {
+    Label *slot = lmap->labels + i;
+    if ( slot->name < 0 )
+      return slot;
+
+    char const *sname = lmap->names + slot->name;
+    if ( slot->hash == hash && strncmp( sname, name, len ) == 0 && sname[ len ] == '\0' )
+      return slot;
+  }
+}
+
+/**
+   Double the number of slots in the table and re-insert all the labels.
+   @param lmap map to enlarge.
+*/
+static void growTable( LabelMap *lmap )
+{
+  Label *old = lmap->labels;
+  int oldCap = lmap->capacity;
+
+  lmap->capacity *= 2;
+  lmap->labels = (Label *) malloc( lmap->capacity * sizeof( Label ) );
+  for ( int i = 0; i < lmap->capacity; i++ )
+    lmap->labels[ i ].name = -1;
+
+  for ( int i = 0; i < oldCap; i++ )
+    if ( old[ i ].name >= 0 )
+      *probe( lmap, lmap->names + old[ i ].name, strlen( lmap->names + old[ i ].name ),
+              old[ i ].hash ) = old[ i ];
+  free( old );
+}
 
 /**
     Return the location of the given label name in the program,
@@ -17,15 +82,16 @@
 */
 int findLabel( LabelMap *lmap, char *name )
 {
-   for (int i = 0; i < lmap->size; i++) {
-     if( strcmp(lmap->labels[i]->name, name) == 0) {
-       return lmap->labels[i]->lineNum;
-     }
-   }
-  return -1;
+  return findLabelLen( lmap, name, strlen( name ) );
 }
 
-/** 
+int findLabelLen( LabelMap *lmap, char const *name, int len )
+{
+  Label *slot = probe( lmap, name, len, hashName( name, len ) );
+  return slot->name < 0 ? -1 : slot->lineNum;
+}
+
+/**
    Initialize the fields of the given labelMap structure.
    @param labelMap Addres of the structure to initialize.
 */
@@ -33,11 +99,17 @@ void initMap( LabelMap *labelMap )
 {
   labelMap->size = 0;
   labelMap->capacity = CAPACITY;
-  labelMap->labels = ( Label **) malloc( CAPACITY * sizeof( Label* ) );
+  labelMap->labels = ( Label *) malloc( CAPACITY * sizeof( Label ) );
+  for ( int i = 0; i < CAPACITY; i++ )
+    labelMap->labels[ i ].name = -1;
+
+  labelMap->namesLen = 0;
+  labelMap->namesCap = NAMES_CAPACITY;
+  labelMap->names = (char *) malloc( NAMES_CAPACITY );
 }
 
 
-/** 
+/**
     Add a label to the given labelMap.  Print an error message and
     exit if the label is a duplicate.
     @param labelMap LabelMap to add a label to.
@@ -46,21 +118,34 @@ void initMap( LabelMap *labelMap )
 */
 void addLabel( LabelMap *labelMap, char *name, int loc )
 {
-  if ( findLabel(labelMap, name) != -1) {
-    printf("Duplicate label: %s", name);
+  addLabelLen( labelMap, name, strlen( name ), loc );
+}
+
+void addLabelLen( LabelMap *labelMap, char const *name, int len, int loc )
+{
+  // Keep the table at most half full, so probe sequences stay short.
+  if ( ( labelMap->size + 1 ) * 2 > labelMap->capacity )
+    growTable( labelMap );
+
+  unsigned int hash = hashName( name, len );
+  Label *slot = probe( labelMap, name, len, hash );
+  if ( slot->name >= 0 ) {
+    printf("Duplicate label: %.*s", len, name);
     exit(1);
   }
-  
-  Label *label = (Label *) malloc( sizeof( Label ) );
-  label->lineNum = loc;
-  label->name = (char *) malloc( sizeof( char ) * (MAX_NAME + 1) );
-  strcpy( label->name, name );
-  
-  if(labelMap->size >= labelMap->capacity) {
-    labelMap->capacity *= 2;
-    labelMap->labels = (Label ** ) realloc(labelMap->labels, labelMap->capacity * sizeof( Label* ) );
+
+  // Copy the name to the end of the name storage.
+  while ( labelMap->namesLen + len + 1 > labelMap->namesCap ) {
+    labelMap->namesCap *= 2;
+    labelMap->names = (char *) realloc( labelMap->names, labelMap->namesCap );
   }
-  labelMap->labels[labelMap->size] = label;
+  memcpy( labelMap->names + labelMap->namesLen, name, len );
+  labelMap->names[ labelMap->namesLen + len ] = '\0';
+
+  slot->name = labelMap->namesLen;
+  slot->hash = hash;
+  slot->lineNum = loc;
+  labelMap->namesLen += len + 1;
   ++(labelMap->size);
 }
 
@@ -69,11 +154,6 @@ void addLabel( LabelMap *labelMap, char *name, int loc )
 */
 void freeMap(LabelMap *lmap)
 {
-  for (int i = 0; i < lmap->size; i++ ) {
-    free(lmap->labels[i]->name);
-    free(lmap->labels[i]);
-  }
-  free(lmap->labels );
+  free( lmap->labels );
+  free( lmap->names );
 }
-
-
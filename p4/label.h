@@ -10,17 +10,37 @@
 
 #define MAX_NAME 20
 
+/** One slot in the label map's hash table. */
 typedef struct {
-   char *name;
+   /** Offset of the label's name in the map's name storage, or -1 if
+       this slot is empty. */
+   int name;
+
+   /** Hash of the name, so most mismatches don't need a strcmp. */
+   unsigned int hash;
+
    int lineNum;
 }Label;
 
 
-/** Map from label names to locations in the code. */
+/** Map from label names to locations in the code.  This is an
+    open-addressing hash table with linear probing.  All the names are
+    stored back-to-back in one block of memory. */
 typedef struct {
    int size;
+
+   /** Number of slots in the table, always a power of two. */
    int capacity;
-   Label **labels; 
+   Label *labels;
+
+   /** Storage for all the names, each with its null terminator. */
+   char *names;
+
+   /** Number of bytes used in the name storage. */
+   int namesLen;
+
+   /** Capacity of the name storage. */
+   int namesCap;
 } LabelMap;
 
 /** Initialize the fields of the given labelMap structure.
@@ -36,12 +56,27 @@ void initMap( LabelMap *labelMap );
 */
 void addLabel( LabelMap *labelMap, char *name, int loc );
 
+/** Add a label to the given labelMap, with a name that isn't null
+    terminated, like a token still in the source text.
+    @param labelMap LabelMap to add a label to.
+    @param name Start of the name of the label to add.
+    @param len Number of characters in the name.
+    @param loc Location of the label in the code.
+*/
+void addLabelLen( LabelMap *labelMap, char const *name, int len, int loc );
+
 /**
     Return the location of the given label name in the program,
     or -1 if its not defined in the label map.
 */
 int findLabel( LabelMap *lmap, char *name );
 
+/**
+    Return the location of the label with the given name, which has
+    len characters and isn't null terminated, or -1 if its not defined.
+*/
+int findLabelLen( LabelMap *lmap, char const *name, int len );
+
 /**
     Free all memory used by the label map.
 */
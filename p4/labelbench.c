@@ -0,0 +1,62 @@
+/**
+   @file labelbench.c
+   @author Prem Subedi
+   Microbenchmark for the label map.  It loads a large number of labels,
+   like a generated script would, then looks every one of them up, and
+   reports how long each phase took.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "label.h"
+
+/** Number of labels to load if none is given on the command line. */
+#define DEFAULT_LABELS 100000
+
+/** Return the current time in seconds, from a monotonic clock.
+    @return current time.
+*/
+static double now()
+{
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** Starting point for the benchmark.
+    @param argc number of command-line arguments
+    @param argv array of command-line arguments
+    @return exit status
+*/
+int main( int argc, char *argv[] )
+{
+  int n = argc > 1 ? atoi( argv[ 1 ] ) : DEFAULT_LABELS;
+  char name[ MAX_NAME + 1 ];
+
+  LabelMap map;
+  initMap( &map );
+
+  double start = now();
+  for ( int i = 0; i < n; i++ ) {
+    snprintf( name, sizeof( name ), "label_%d", i );
+    addLabel( &map, name, i );
+  }
+  double loaded = now();
+
+  // Look up every label, and make sure each one is where we put it.
+  for ( int i = 0; i < n; i++ ) {
+    snprintf( name, sizeof( name ), "label_%d", i );
+    if ( findLabel( &map, name ) != i ) {
+      fprintf( stderr, "Wrong location for %s\n", name );
+      exit( EXIT_FAILURE );
+    }
+  }
+  double found = now();
+
+  printf( "%d labels: load %.3f ms, lookup %.3f ms\n", n,
+          ( loaded - start ) * 1000, ( found - loaded ) * 1000 );
+
+  freeMap( &map );
+  return EXIT_SUCCESS;
+}
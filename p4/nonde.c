@@ -2,99 +2,163 @@
    @file nonde.c
    @author Prem Subedi
    This component contains the main() function.
-   It uses the other components to parse and execute commands from the input script.
+   It uses the nonde library to compile and run the input script.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include "command.h"
-#include "label.h"
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
 #include "parse.h"
+#include "program.h"
+#include "optimize.h"
+#include "profile.h"
 
-/** Initial capacity for resizable arrays. */
-#define INITIAL_CAPACITY 5
-
-/** Growth rate (multiplier) for resizable arrays. */
-#define GROWTH_RATE 2
-
-/** Type used to represent a whole program, including a list of commands and
-    a record of where all the labels are. */
-typedef struct {
-  /** Sequence of all the commands in the program. */
-  Command **cmd;
-
-  /** Number of commands in the program. */
-  int count;
-
-  /** Capacity of the command list, free resize behavior. */
-  int cap;
-
-  /** Label map, for the targets of if and goto. */
-  LabelMap *labelMap;
-} Program;
+/** Return the current time in seconds, from a monotonic clock.
+    @return current time.
+*/
+static double now()
+{
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
 
 /** Print a short usage message, then exit. */
 static void usage()
 {
-  fprintf( stderr, "usage: nonde <script>\n" );
+  fprintf( stderr, "usage: nonde [-O] [--dump] [--profile] [--check-overflow] [--no-trace]\n"
+           "             [--unbuffered] [--stats] [--cache <image>] <script>\n"
+           "       nonde [-O] [--check-overflow] [--no-trace] --batch <inputs> [-j N]\n"
+           "             <script>\n"
+           "       nonde [-O] -o <image> <script>\n" );
   exit( EXIT_FAILURE );
 }
 
-/** Initialize the given Program structure and read in the program
-    definition from the given file.
-    @param prog Program structure to populate.
-    @param fp File to read from.
+/** Print the profile report for a program that was run, with a block
+    for each label.
+    @param prog program that was profiled.
+    @param prof counters from the run.
 */
-static void loadProgram( Program *prog, FILE *fp )
+static void reportRun( NondeProgram const *prog, Profile const *prof )
 {
-  // Initialize the array of command pointers.
-  prog->count = 0;
-  prog->cap = INITIAL_CAPACITY;
-  prog->cmd = (Command **) malloc( prog->cap * sizeof( Command * ) );
-
-  // Initialize the labelMap structure in the program.
-  initMap( &prog->labelMap );
-
-  // One token of read-ahead, so we can tell what's next in the program.
-  char tok[ MAX_TOKEN + 1 ];
-  while ( parseToken( tok, fp ) ) {
-
-    // Is this token a label?
-    int tlen = strlen( tok );
-    if ( tok[ tlen - 1 ] == ':' ) {
-      // Throw away the : at the end, and put it in the map.
-      tok[ tlen - 1 ] = '\0';
-      if ( !isVarName( tok ) )
-        syntaxError();
-      addLabel( &prog->labelMap, tok, prog->count );
-    } else {
-      // If it's not a label, it must be a command.
-      Command *cmd = parseCommand( tok, fp );
-
-      // Enlarge the command list if needed, and store the new command.
-      if ( prog->count >= prog->cap ) {
-        prog->cap *= GROWTH_RATE;
-        prog->cmd = (Command **) realloc( prog->cmd, prog->cap * sizeof( Command * ) );
-      }
-      prog->cmd[ prog->count ++ ] = cmd;
+  // Each label starts a block, at the line of the command it labels.
+  LabelMap const *map = &prog->labelMap;
+  BlockStart *blocks = (BlockStart *) malloc( ( map->size + 1 ) * sizeof( BlockStart ) );
+  int nblocks = 0;
+  for ( int i = 0; i < map->capacity; i++ ) {
+    Label const *lab = map->labels + i;
+    if ( lab->name >= 0 && lab->lineNum < prog->count ) {
+      blocks[ nblocks ].name = map->names + lab->name;
+      blocks[ nblocks ].line = prog->cmd ? prog->cmd[ lab->lineNum ]->line
+        : prog->cmdLine[ lab->lineNum ];
+      nblocks++;
     }
   }
+
+  reportProfile( prof, &prog->code, blocks, nblocks, stderr );
+  free( blocks );
+}
+
+/** Make sure a script can be read twice, once to check it against a
+    cached image and again to compile it if the image doesn't match.  A
+    script that can't be rewound, like a pipe, is copied into a
+    temporary file first.
+    @param fp the script.
+    @return a file with the script that can be rewound, which may be
+    fp, or NULL if the script couldn't be copied.
+*/
+static FILE *rewindableScript( FILE *fp )
+{
+  if ( fseek( fp, 0, SEEK_CUR ) == 0 )
+    return fp;
+
+  FILE *tmp = tmpfile();
+  if ( tmp == NULL )
+    return NULL;
+  char buf[ 65536 ];
+  size_t n;
+  bool ok = true;
+  while ( ok && ( n = fread( buf, 1, sizeof( buf ), fp ) ) > 0 )
+    ok = fwrite( buf, 1, n, tmp ) == n;
+  if ( !ok || ferror( fp ) || fseek( tmp, 0, SEEK_SET ) != 0 ) {
+    fclose( tmp );
+    return NULL;
+  }
+  fclose( fp );
+  return tmp;
 }
 
-/** Free memory for a program.
-    @param prog A pointer to the program we're supposed to free.
+/** Read the inputs for a batch, one run per line.  Each line is a list
+    of NAME=value bindings separated by spaces or tabs.  Blank lines are
+    skipped.  Exits with an error message if a line can't be used.
+    @param fp file to read the inputs from.
+    @param textp storage for the text of the file, which the bindings
+    point into.  The caller frees this.
+    @param count storage for the number of runs.
+    @return list of bindings for each run.  The caller frees each list
+    of bindings, then this list.
 */
-static void freeProgram( Program *prog )
+static char ***readInputs( FILE *fp, char **textp, int *count )
 {
-    if ( !prog ) return;
-   
-    for (int i = 0; i < prog->count; i++ ) {
-       prog->cmd[i]->destroy(prog->cmd[i]);
+  // Read the whole file, since the bindings point into it.
+  size_t len = 0, cap = 1024;
+  char *text = (char *) malloc( cap );
+  size_t n;
+  while ( ( n = fread( text + len, 1, cap - len - 1, fp ) ) > 0 ) {
+    len += n;
+    if ( len + 1 == cap ) {
+      cap *= 2;
+      text = (char *) realloc( text, cap );
     }
-    freeMap( &prog->labelMap);
-    free(prog->cmd);
-    prog->count = prog->cap = 0;
+  }
+  text[ len ] = '\0';
+  *textp = text;
+
+  int cap2 = 16;
+  char ***inputs = (char ***) malloc( cap2 * sizeof( char ** ) );
+  *count = 0;
+  int lineNum = 0;
+  for ( char *line = text; line < text + len; ) {
+    char *end = strchr( line, '\n' );
+    if ( !end )
+      end = text + len;
+    *end = '\0';
+    lineNum++;
+
+    // Split the line into bindings, in place.
+    int bcap = 4, nb = 0;
+    char **bindings = (char **) malloc( bcap * sizeof( char * ) );
+    for ( char *tok = strtok( line, " \t\r" ); tok; tok = strtok( NULL, " \t\r" ) ) {
+      char *eq = strchr( tok, '=' );
+      if ( !eq || !isVarNameLen( tok, eq - tok ) ) {
+        fprintf( stderr, "Invalid input (line %d)\n", lineNum );
+        exit( EXIT_FAILURE );
+      }
+      if ( nb + 1 >= bcap ) {
+        bcap *= 2;
+        bindings = (char **) realloc( bindings, bcap * sizeof( char * ) );
+      }
+      bindings[ nb++ ] = tok;
+    }
+    bindings[ nb ] = NULL;
+
+    if ( nb == 0 ) {
+      free( bindings );
+    } else {
+      if ( *count >= cap2 ) {
+        cap2 *= 2;
+        inputs = (char ***) realloc( inputs, cap2 * sizeof( char ** ) );
+      }
+      inputs[ ( *count )++ ] = bindings;
+    }
+    line = end + 1;
+  }
+
+  return inputs;
 }
 
 /** Starting point for the program
@@ -104,28 +168,159 @@ static void freeProgram( Program *prog )
 */
 int main( int argc, char *argv[] )
 {
+  // Options, -O to optimize the program and --dump to print the
+  // compiled instructions instead of running them, --profile to
+  // report where the time went, and --check-overflow to stop with an
+  // error if arithmetic overflows 64 bits.  --no-trace turns off
+  // tracing hot loops.  --unbuffered writes output as soon as it's
+  // printed, which is the default if it's going to a terminal.
+  // --stats reports how long parsing and running took, and the peak
+  // memory use, for benchmarking.
+  // --batch runs the script once for each line of an inputs file, on
+  // -j threads.  -o compiles the script to a binary image instead of
+  // running it, and --cache runs from an image if it's up to date
+  // with the script, and otherwise compiles it and saves the image.
+  bool optimize = false;
+  bool dump = false;
+  bool profile = false;
+  bool checkOverflow = false;
+  bool noTrace = false;
+  bool unbuffered = isatty( STDOUT_FILENO );
+  bool stats = false;
+  char const *batch = NULL;
+  char const *image = NULL;
+  bool save = false;
+  int threads = sysconf( _SC_NPROCESSORS_ONLN );
+  int arg = 1;
+  for ( ; arg < argc && argv[ arg ][ 0 ] == '-'; arg++ ) {
+    if ( strcmp( argv[ arg ], "-O" ) == 0 )
+      optimize = true;
+    else if ( strcmp( argv[ arg ], "--dump" ) == 0 )
+      dump = true;
+    else if ( strcmp( argv[ arg ], "--profile" ) == 0 )
+      profile = true;
+    else if ( strcmp( argv[ arg ], "--check-overflow" ) == 0 )
+      checkOverflow = true;
+    else if ( strcmp( argv[ arg ], "--no-trace" ) == 0 )
+      noTrace = true;
+    else if ( strcmp( argv[ arg ], "--unbuffered" ) == 0 )
+      unbuffered = true;
+    else if ( strcmp( argv[ arg ], "--stats" ) == 0 )
+      stats = true;
+    else if ( strcmp( argv[ arg ], "--batch" ) == 0 && arg + 1 < argc )
+      batch = argv[ ++arg ];
+    else if ( strcmp( argv[ arg ], "-o" ) == 0 && arg + 1 < argc ) {
+      image = argv[ ++arg ];
+      save = true;
+    } else if ( strcmp( argv[ arg ], "--cache" ) == 0 && arg + 1 < argc )
+      image = argv[ ++arg ];
+    else if ( strcmp( argv[ arg ], "-j" ) == 0 && arg + 1 < argc ) {
+      threads = atoi( argv[ ++arg ] );
+      if ( threads < 1 )
+        usage();
+    } else
+      usage();
+  }
+
   // Make sure we get one filename on the command line, and that we can open the file.
-  if ( argc != 2 )
+  if ( arg != argc - 1 || ( batch && ( dump || profile ) ) ||
+       ( save && ( batch || dump || profile ) ) )
     usage();
 
-  FILE *fp = fopen( argv[ 1 ], "r" );
+  FILE *fp = fopen( argv[ arg ], "r" );
   if ( fp == NULL ) {
-    fprintf( stderr, "Can't open file: %s\n", argv[ 1 ] );
+    fprintf( stderr, "Can't open file: %s\n", argv[ arg ] );
     usage();
   }
 
-  // Make a program structure, and load it from the given file.
-  Program prog;
-  loadProgram( &prog, fp );
+  // Load the program and turn it into bytecode.
+  struct stat st;
+  long size = fstat( fileno( fp ), &st ) == 0 ? st.st_size : 0;
+  double start = now();
+  int flags = ( optimize ? NONDE_OPTIMIZE : 0 ) | ( checkOverflow ? NONDE_CHECK_OVERFLOW : 0 ) |
+    ( noTrace ? NONDE_NO_TRACE : 0 );
+  NondeProgram *prog = NULL;
+  if ( image && !save ) {
+    FILE *script = rewindableScript( fp );
+    if ( script == NULL ) {
+      fprintf( stderr, "Can't read file\n" );
+      fclose( fp );
+      exit( EXIT_FAILURE );
+    }
+    fp = script;
+    prog = nondeLoadImage( image, fp, flags );
+    if ( !prog && fseek( fp, 0, SEEK_SET ) != 0 ) {
+      fprintf( stderr, "Can't read file\n" );
+      fclose( fp );
+      exit( EXIT_FAILURE );
+    }
+  }
+  bool compiled = !prog;
+  if ( compiled )
+    prog = nondeCompile( fp, flags );
   fclose( fp );
+  if ( !prog ) {
+    fprintf( stderr, "Can't read file\n" );
+    exit( EXIT_FAILURE );
+  }
+  double parsed = now();
+
+  // A cache that can't be written just means we parse again next time,
+  // but an image that was asked for has to be written.
+  if ( image && compiled && nondeSaveImage( prog, image ) != 0 && save ) {
+    fprintf( stderr, "Can't write image: %s\n", image );
+    nondeFree( prog );
+    exit( EXIT_FAILURE );
+  }
+
+  // Run it until we reach the end (possibly looping as we run).
+  int status = EXIT_SUCCESS;
+  if ( dump )
+    dumpCode( &prog->code, stdout );
+  else if ( batch ) {
+    FILE *ifp = fopen( batch, "r" );
+    if ( ifp == NULL ) {
+      fprintf( stderr, "Can't open file: %s\n", batch );
+      usage();
+    }
+    char *text;
+    int count;
+    char ***inputs = readInputs( ifp, &text, &count );
+    fclose( ifp );
+
+    status = nondeRunBatch( prog, (char const *const *const *) inputs, count, threads,
+                            stdout, stderr );
 
-  // Index of the current command.
-  int pc = 0;
+    for ( int i = 0; i < count; i++ )
+      free( inputs[ i ] );
+    free( inputs );
+    free( text );
+  } else if ( !save ) {
+    // Output is collected in a buffer and written straight to the
+    // file descriptor, instead of going through stdout.
+    Output out;
+    initOutput( &out, STDOUT_FILENO, unbuffered );
+    Profile prof;
+    if ( profile )
+      initProfile( &prof, &prog->code );
 
-  // Run commands int he program until we reach the end (possibly
-  // looping as we run).
-  while ( pc < prog.count )
-    pc = prog.cmd[ pc ]->execute( prog.cmd[ pc ], & prog.labelMap, pc );
+    status = runCode( &prog->code, NULL, &out, stderr, profile ? &prof : NULL );
+    freeOutput( &out );
 
-  freeProgram( &prog );
+    if ( profile ) {
+      reportRun( prog, &prof );
+      freeProfile( &prof );
+    }
+  }
+
+  double done = now();
+  nondeFree( prog );
+
+  if ( stats ) {
+    struct rusage usage;
+    getrusage( RUSAGE_SELF, &usage );
+    fprintf( stderr, "stats: parse %ld bytes in %.6f s, run %.6f s, peak RSS %ld KB\n",
+             size, parsed - start, done - parsed, usage.ru_maxrss );
+  }
+  return status;
 }
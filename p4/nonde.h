@@ -0,0 +1,96 @@
+/**
+  @file nonde.h
+  @author Prem Subedi
+  Public interface to the nonde runtime, for programs that embed it.
+  A script is compiled once, then it can be run any number of times,
+  each with its own starting values for its variables.
+*/
+
+#ifndef _NONDE_H_
+#define _NONDE_H_
+
+#include <stdio.h>
+
+/** A compiled script.  The fields are private to the library. */
+typedef struct NondeProgramStruct NondeProgram;
+
+/** Flag for nondeCompile(), to run the optimizer over the program. */
+#define NONDE_OPTIMIZE 0x1
+
+/** Flag for nondeCompile(), to report arithmetic that overflows 64
+    bits as an error instead of letting it wrap around. */
+#define NONDE_CHECK_OVERFLOW 0x2
+
+/** Flag for nondeCompile(), to run every instruction through the
+    interpreter, without recording traces for hot loops. */
+#define NONDE_NO_TRACE 0x4
+
+/** Read a script from the given file and compile it.  A syntax error
+    in the script is reported and exits, the same as for nonde.
+    @param fp file to read the script from.
+    @param flags any of NONDE_OPTIMIZE, NONDE_CHECK_OVERFLOW and
+    NONDE_NO_TRACE, or'ed together.
+    @return the compiled program, or NULL if the file couldn't be read.
+*/
+NondeProgram *nondeCompile( FILE *fp, int flags );
+
+/** Run a compiled program from the start.  The program isn't changed
+    by running it, so it can be run again, even by several threads at
+    once.
+    @param prog program to run.
+    @param bindings NULL-terminated list of NAME=value strings, the
+    starting values for the program's variables.  Variables that
+    aren't listed start out undefined.  If this is NULL, variables get
+    their starting values from the environment.
+    @param out stream for the program's output.
+    @param err stream for the message if there's a runtime error.
+    @return 0 if the program ran to the end, or 1 if it stopped with a
+    runtime error.
+*/
+int nondeRun( NondeProgram const *prog, char const *const *bindings, FILE *out, FILE *err );
+
+/** Run a compiled program once for each of a list of inputs, spread
+    over a pool of threads.  The output and any error message from
+    each run are written out in the same order as the inputs.
+    @param prog program to run.
+    @param inputs list of bindings for each run, as for nondeRun().
+    @param count number of runs.
+    @param threads number of worker threads to use.
+    @param out stream for the output of all the runs.
+    @param err stream for any error messages.
+    @return 0 if every run got to the end, or 1 if any of them
+    stopped with a runtime error.
+*/
+int nondeRunBatch( NondeProgram const *prog, char const *const *const *inputs, int count,
+                   int threads, FILE *out, FILE *err );
+
+/** Write a compiled program to a binary image, so later runs can load
+    it with nondeLoadImage() instead of parsing the script again.  The
+    image is written to a temporary file that's renamed into place, so
+    a program loading it never sees half an image.
+    @param prog program to save.
+    @param path name of the image file.
+    @return 0 if the image was written, or -1 if it couldn't be.
+*/
+int nondeSaveImage( NondeProgram const *prog, char const *path );
+
+/** Load a program from an image written by nondeSaveImage().  The
+    image is mapped into memory and run in place, without parsing
+    anything.  It's only used if it was made from a script with the
+    same contents, as checked by a hash, and with the same
+    optimization.
+    @param path name of the image file.
+    @param source file with the script the image should be for.  This
+    is read to the end.
+    @param flags flags for running the program, as for nondeCompile().
+    @return the program, or NULL if the image couldn't be read, is
+    damaged, or is out of date.
+*/
+NondeProgram *nondeLoadImage( char const *path, FILE *source, int flags );
+
+/** Free all the memory for a compiled program.
+    @param prog program to free.
+*/
+void nondeFree( NondeProgram *prog );
+
+#endif
@@ -0,0 +1,464 @@
+/**
+   @file optimize.c
+   @author Prem Subedi
+   This component contains an optional optimization pass over compiled
+   programs.  Each step rewrites the instruction array in place, and
+   deleted instructions are squeezed out with all the jump targets
+   adjusted to match.
+ */
+
+#include "optimize.h"
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+/** Names of the opcodes, for the listing. */
+static char const *opNames[] = {
+  "print", "set", "add", "sub", "mult", "div", "mod", "eq", "less",
+  "if", "goto", "jeq", "jless", "divmod", "concat", "length", "substr", "compare"
+};
+
+/**
+   Return true if the given instruction can jump somewhere other than
+   the next instruction.
+   @param op opcode of the instruction.
+   @return true if it's a jump.
+*/
+static bool isJump( Opcode op )
+{
+  return op == OP_IF || op == OP_GOTO || op == OP_JEQ || op == OP_JLESS;
+}
+
+/**
+   Make an array saying which instructions are the target of a jump.
+   These are the starts of basic blocks.
+   @param code program to look at.
+   @return array of count + 1 flags, to be freed by the caller.
+*/
+static bool *findTargets( Code const *code )
+{
+  bool *isTarget = (bool *) calloc( code->count + 1, sizeof( bool ) );
+  for ( int i = 0; i < code->count; i++ )
+    if ( isJump( code->instr[ i ].op ) && code->instr[ i ].target >= 0 )
+      isTarget[ code->instr[ i ].target ] = true;
+  return isTarget;
+}
+
+/**
+   Remove the instructions marked as dead, and adjust the jump targets.
+   A jump to a removed instruction goes to the next one that's kept.
+   @param code program to compact.
+   @param dead flags for the instructions to remove.
+   @return number of instructions removed.
+*/
+static int compact( Code *code, bool const *dead )
+{
+  int *newIndex = (int *) malloc( ( code->count + 1 ) * sizeof( int ) );
+  int n = 0;
+  for ( int i = 0; i < code->count; i++ ) {
+    newIndex[ i ] = n;
+    if ( !dead[ i ] )
+      code->instr[ n++ ] = code->instr[ i ];
+  }
+  newIndex[ code->count ] = n;
+
+  for ( int i = 0; i < n; i++ )
+    if ( isJump( code->instr[ i ].op ) && code->instr[ i ].target >= 0 )
+      code->instr[ i ].target = newIndex[ code->instr[ i ].target ];
+
+  int removed = code->count - n;
+  code->count = n;
+  free( newIndex );
+  return removed;
+}
+
+/**
+   Return the slot for a literal with the given text, adding it to the
+   variable table if it's not already there.
+   @param vars table of variables and literals.
+   @param text text of the literal.
+   @return slot for the literal.
+*/
+static int literalSlot( VarTable *vars, char const *text )
+{
+  return operandSlot( vars, internLiteral( vars, text, strlen( text ) ) );
+}
+
+/**
+   Try to compute the result of an arithmetic instruction on two
+   literals, as the text of a literal for the result.
+   @param vars table of variables and literals.
+   @param in the instruction, with both sources already known to be literals.
+   @param text storage for the text of the result.
+   @return true if the result could be computed.  It can't if either
+   source isn't a number, on a divide by zero, or if the result
+   overflows, since those may need to be reported when the program
+   runs.
+*/
+static bool foldArithmetic( VarTable const *vars, Instr const *in, char *text )
+{
+  Value v1 = makeStringValue( vars->consts[ in->arg[ 1 ] - vars->varCount ] );
+  Value v2 = makeStringValue( vars->consts[ in->arg[ 2 ] - vars->varCount ] );
+  if ( !v1.numeric || !v2.numeric )
+    return false;
+
+  int64_t l1 = v1.num;
+  int64_t l2 = v2.num;
+  int64_t ans;
+  switch ( in->op ) {
+  case OP_EQ:
+    strcpy( text, l1 == l2 ? "1" : "" );
+    return true;
+  case OP_LESS:
+    strcpy( text, l1 < l2 ? "1" : "" );
+    return true;
+  case OP_DIVMOD:
+    // This has two results, so it's left alone.
+    return false;
+  default:
+    if ( ( in->op == OP_DIV || in->op == OP_MOD ) && l2 == 0 )
+      return false;
+    if ( !computeArithmetic( in->op, l1, l2, &ans ) )
+      return false;
+  }
+
+  sprintf( text, "%" PRId64, ans );
+  return true;
+}
+
+/**
+   If the given source operand is a variable known to hold a literal,
+   replace it with the literal.
+   @param arg address of the operand.
+   @param nvars number of variables.
+   @param known for each variable, the slot of the literal it holds.
+   @param gen for each variable, the block its entry in known is valid for.
+   @param block the current block.
+*/
+static void useKnown( int *arg, int nvars, int const *known, int const *gen, int block )
+{
+  if ( *arg < nvars && gen[ *arg ] == block )
+    *arg = known[ *arg ];
+}
+
+/**
+   Fold instructions whose sources are all literals.  Within a basic
+   block, a variable that was just set to a literal is treated as that
+   literal, so later uses of it can be folded too.  An if on a literal
+   becomes a goto, either to its label or to the next instruction.
+   @param code program to rewrite.
+   @param vars table of variables and literals.
+*/
+static void foldConstants( Code *code, VarTable *vars )
+{
+  int nvars = vars->varCount;
+  bool *isTarget = findTargets( code );
+
+  // For each variable, the slot of the literal it holds.  This is only
+  // valid if the variable's entry in gen matches the current block.
+  int *known = (int *) malloc( ( nvars + 1 ) * sizeof( int ) );
+  int *gen = (int *) calloc( nvars + 1, sizeof( int ) );
+  int block = 1;
+
+  for ( int i = 0; i < code->count; i++ ) {
+    Instr *in = code->instr + i;
+    if ( isTarget[ i ] )
+      block++;
+
+    // Replace variables that are known to hold a literal, then see if
+    // the instruction can be worked out now.
+    switch ( in->op ) {
+    case OP_PRINT:
+      useKnown( in->arg, nvars, known, gen, block );
+      break;
+
+    case OP_IF:
+      useKnown( in->arg, nvars, known, gen, block );
+      if ( in->arg[ 0 ] >= nvars ) {
+        Value v = makeStringValue( vars->consts[ in->arg[ 0 ] - nvars ] );
+        in->op = OP_GOTO;
+        if ( !v.numeric || !v.num )
+          in->target = i + 1;
+      }
+      break;
+
+    case OP_GOTO:
+      // Only a jump can reach the next instruction.
+      block++;
+      break;
+
+    case OP_SET:
+    case OP_LENGTH:
+      useKnown( in->arg + 1, nvars, known, gen, block );
+      break;
+
+    case OP_SUBSTR:
+      useKnown( in->arg + 3, nvars, known, gen, block );
+      // Fall through, for the other two sources.
+    case OP_CONCAT:
+    case OP_COMPARE:
+      // Strings aren't folded, but literals can still stand in for
+      // variables.
+      useKnown( in->arg + 1, nvars, known, gen, block );
+      useKnown( in->arg + 2, nvars, known, gen, block );
+      break;
+
+    default:
+      useKnown( in->arg + 1, nvars, known, gen, block );
+      useKnown( in->arg + 2, nvars, known, gen, block );
+      char text[ 32 ];
+      if ( in->arg[ 1 ] >= nvars && in->arg[ 2 ] >= nvars && foldArithmetic( vars, in, text ) ) {
+        in->op = OP_SET;
+        in->arg[ 1 ] = literalSlot( vars, text );
+      }
+      break;
+    }
+
+    // Keep up with what the destination holds now.
+    if ( in->op == OP_SET ) {
+      known[ in->arg[ 0 ] ] = in->arg[ 1 ];
+      gen[ in->arg[ 0 ] ] = in->arg[ 1 ] >= nvars ? block : 0;
+    } else if ( in->op != OP_PRINT && in->op != OP_IF && in->op != OP_GOTO ) {
+      gen[ in->arg[ 0 ] ] = 0;
+      if ( in->op == OP_DIVMOD )
+        gen[ in->arg[ 3 ] ] = 0;
+    }
+  }
+
+  free( known );
+  free( gen );
+  free( isTarget );
+}
+
+/**
+   Make every jump that lands on a goto jump straight to where the goto
+   would take it.
+   @param code program to rewrite.
+*/
+static void threadJumps( Code *code )
+{
+  Instr *instr = code->instr;
+  for ( int i = 0; i < code->count; i++ ) {
+    if ( !isJump( instr[ i ].op ) )
+      continue;
+
+    // Follow the chain of gotos, but stop at one with an undefined label
+    // so the error is still reported where it is now, and don't go
+    // around a loop of gotos forever.
+    int t = instr[ i ].target;
+    for ( int steps = 0; t >= 0 && t < code->count && instr[ t ].op == OP_GOTO &&
+            instr[ t ].target >= 0 && steps < code->count; steps++ )
+      t = instr[ t ].target;
+    instr[ i ].target = t;
+  }
+}
+
+/**
+   Fuse each eq or less with an immediately following if on its result
+   into one conditional jump.  The comparison result is still stored,
+   in case it's used later.
+   @param code program to rewrite.
+*/
+static void fuseCompares( Code *code )
+{
+  Instr *instr = code->instr;
+  bool *isTarget = findTargets( code );
+  bool *dead = (bool *) calloc( code->count + 1, sizeof( bool ) );
+
+  for ( int i = 0; i + 1 < code->count; i++ ) {
+    Instr *cmp = instr + i;
+    Instr *br = instr + i + 1;
+    if ( ( cmp->op == OP_EQ || cmp->op == OP_LESS ) && br->op == OP_IF &&
+         !isTarget[ i + 1 ] && br->arg[ 0 ] == cmp->arg[ 0 ] && br->target >= 0 ) {
+      cmp->op = cmp->op == OP_EQ ? OP_JEQ : OP_JLESS;
+      cmp->target = br->target;
+      dead[ i + 1 ] = true;
+      i++;
+    }
+  }
+
+  compact( code, dead );
+  free( dead );
+  free( isTarget );
+}
+
+/**
+   Return true if the given instruction writes its result to a slot
+   it also reads.
+   @param in the instruction.
+   @return true if the destination is one of the sources.
+*/
+static bool overwritesSource( Instr const *in )
+{
+  return in->arg[ 0 ] == in->arg[ 1 ] || in->arg[ 0 ] == in->arg[ 2 ];
+}
+
+/**
+   Fuse a div followed by a mod of the same two operands into a divmod
+   that gets both results from one division.  This only works if the
+   div doesn't change an operand the mod needs.  Any error is reported
+   for the div's line either way.
+   @param code program to rewrite.
+*/
+static void fuseDivMod( Code *code )
+{
+  Instr *instr = code->instr;
+  bool *isTarget = findTargets( code );
+  bool *dead = (bool *) calloc( code->count + 1, sizeof( bool ) );
+
+  for ( int i = 0; i + 1 < code->count; i++ ) {
+    Instr *div = instr + i;
+    Instr *mod = instr + i + 1;
+    if ( div->op == OP_DIV && mod->op == OP_MOD && !isTarget[ i + 1 ] &&
+         div->arg[ 1 ] == mod->arg[ 1 ] && div->arg[ 2 ] == mod->arg[ 2 ] &&
+         !overwritesSource( div ) ) {
+      // The divmod stores the quotient then the remainder, so if they
+      // go to the same variable the remainder still wins.
+      div->op = OP_DIVMOD;
+      div->arg[ 3 ] = mod->arg[ 0 ];
+      dead[ i + 1 ] = true;
+      i++;
+    }
+  }
+
+  compact( code, dead );
+  free( dead );
+  free( isTarget );
+}
+
+/**
+   Remove code that can't be reached, and gotos that just go to the
+   next instruction.  Removing one can expose more, so this repeats
+   until there's nothing left to remove.
+   @param code program to rewrite.
+*/
+static void removeDeadCode( Code *code )
+{
+  int removed;
+  do {
+    Instr *instr = code->instr;
+    int count = code->count;
+    bool *dead = (bool *) malloc( ( count + 1 ) * sizeof( bool ) );
+    int *stack = (int *) malloc( ( count + 1 ) * sizeof( int ) );
+
+    // Everything is dead, until we find a path to it from the start.
+    for ( int i = 0; i < count; i++ )
+      dead[ i ] = true;
+    int top = 0;
+    if ( count > 0 ) {
+      dead[ 0 ] = false;
+      stack[ top++ ] = 0;
+    }
+    while ( top > 0 ) {
+      int i = stack[ --top ];
+      int next[ 2 ];
+      int n = 0;
+      if ( instr[ i ].op != OP_GOTO )
+        next[ n++ ] = i + 1;
+      if ( isJump( instr[ i ].op ) && instr[ i ].target >= 0 )
+        next[ n++ ] = instr[ i ].target;
+      for ( int j = 0; j < n; j++ )
+        if ( next[ j ] < count && dead[ next[ j ] ] ) {
+          dead[ next[ j ] ] = false;
+          stack[ top++ ] = next[ j ];
+        }
+    }
+
+    // A goto is useless if there's nothing live between it and its target.
+    for ( int i = 0; i < count; i++ ) {
+      if ( dead[ i ] || instr[ i ].op != OP_GOTO || instr[ i ].target <= i )
+        continue;
+      int j = i + 1;
+      while ( j < instr[ i ].target && dead[ j ] )
+        j++;
+      if ( j == instr[ i ].target )
+        dead[ i ] = true;
+    }
+
+    removed = compact( code, dead );
+    free( dead );
+    free( stack );
+  } while ( removed > 0 );
+}
+
+void optimizeCode( Code *code, VarTable *vars )
+{
+  foldConstants( code, vars );
+  threadJumps( code );
+  fuseCompares( code );
+  fuseDivMod( code );
+  removeDeadCode( code );
+}
+
+/**
+   Print an operand for the listing, either a variable name or a
+   literal in double quotes.
+   @param code program the operand belongs to.
+   @param slot slot of the operand.
+   @param fp stream to print to.
+*/
+static void dumpOperand( Code const *code, int slot, FILE *fp )
+{
+  VarTable const *vars = code->vars;
+  if ( slot < vars->varCount ) {
+    fprintf( fp, " %s", vars->names[ slot ] );
+    return;
+  }
+
+  fprintf( fp, " \"" );
+  for ( char const *p = vars->consts[ slot - vars->varCount ]; *p; p++ ) {
+    if ( *p == '\n' )
+      fprintf( fp, "\\n" );
+    else if ( *p == '\t' )
+      fprintf( fp, "\\t" );
+    else if ( *p == '"' || *p == '\\' )
+      fprintf( fp, "\\%c", *p );
+    else
+      fputc( *p, fp );
+  }
+  fputc( '"', fp );
+}
+
+void dumpCode( Code const *code, FILE *fp )
+{
+  for ( int i = 0; i < code->count; i++ ) {
+    Instr const *in = code->instr + i;
+    fprintf( fp, "%5d  line %-5d %-7s", i, in->line, opNames[ in->op ] );
+
+    switch ( in->op ) {
+    case OP_PRINT:
+    case OP_IF:
+      dumpOperand( code, in->arg[ 0 ], fp );
+      break;
+    case OP_SET:
+    case OP_LENGTH:
+      dumpOperand( code, in->arg[ 0 ], fp );
+      dumpOperand( code, in->arg[ 1 ], fp );
+      break;
+    case OP_SUBSTR:
+      for ( int j = 0; j < 4; j++ )
+        dumpOperand( code, in->arg[ j ], fp );
+      break;
+    case OP_GOTO:
+      break;
+    case OP_DIVMOD:
+      dumpOperand( code, in->arg[ 0 ], fp );
+      dumpOperand( code, in->arg[ 3 ], fp );
+      dumpOperand( code, in->arg[ 1 ], fp );
+      dumpOperand( code, in->arg[ 2 ], fp );
+      break;
+    default:
+      for ( int j = 0; j < 3; j++ )
+        dumpOperand( code, in->arg[ j ], fp );
+      break;
+    }
+
+    if ( isJump( in->op ) ) {
+      if ( in->target >= 0 )
+        fprintf( fp, " -> %d", in->target );
+      else
+        fprintf( fp, " -> undefined %s", code->vars->consts[ in->arg[ 2 ] - code->vars->varCount ] );
+    }
+    fputc( '\n', fp );
+  }
+}
@@ -0,0 +1,33 @@
+/**
+  @file optimize.h
+  @author Prem Subedi
+  Optional optimization pass over compiled programs, and a listing of
+  the instructions so the result can be checked.
+*/
+
+#ifndef _OPTIMIZE_H_
+#define _OPTIMIZE_H_
+
+#include <stdio.h>
+#include "bytecode.h"
+
+/** Rewrite a compiled program so it runs fewer instructions.  This
+    folds arithmetic on literals (including variables set to a literal
+    earlier in the same basic block), fuses eq and less with a
+    following if into a single conditional jump, fuses a div and mod
+    of the same operands into a divmod, threads jumps that
+    land on a goto, and removes gotos to the next instruction and code
+    that can never be reached.
+    @param code Compiled program to rewrite.
+    @param vars Table the program's operands refer to.  Literals for
+    folded results are added to it.
+*/
+void optimizeCode( Code *code, VarTable *vars );
+
+/** Print a listing of a compiled program, one instruction per line.
+    @param code Compiled program to list.
+    @param fp Stream to print the listing to.
+*/
+void dumpCode( Code const *code, FILE *fp );
+
+#endif
@@ -0,0 +1,123 @@
+/**
+   @file output.c
+   @author Prem Subedi
+   This component collects a program's output in a buffer, and writes
+   it out with a few large write() calls instead of a stdio call for
+   every print.
+ */
+
+#include "output.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+/** Size of the buffer for output that goes to a file. */
+#define BUFFER_SIZE 65536
+
+/** Most characters an int64_t can print as. */
+#define MAX_DIGITS 20
+
+/**
+   Set up the buffer for an Output.
+   @param out Output to initialize.
+   @param cap starting capacity of the buffer.
+*/
+static void initBuffer( Output *out, int cap )
+{
+  out->data = (char *) malloc( cap );
+  out->len = 0;
+  out->cap = cap;
+  out->fd = -1;
+  out->fp = NULL;
+  out->unbuffered = false;
+}
+
+void initOutput( Output *out, int fd, bool unbuffered )
+{
+  initBuffer( out, BUFFER_SIZE );
+  out->fd = fd;
+  out->unbuffered = unbuffered;
+}
+
+void initStreamOutput( Output *out, FILE *fp )
+{
+  initBuffer( out, BUFFER_SIZE );
+  fflush( fp );
+  out->fd = fileno( fp );
+  if ( out->fd < 0 )
+    out->fp = fp;
+}
+
+void initMemoryOutput( Output *out )
+{
+  initBuffer( out, 1024 );
+}
+
+void flushOutput( Output *out )
+{
+  if ( out->fd >= 0 ) {
+    // Keep going until it's all written, write() can do part of it.
+    char const *p = out->data;
+    char const *end = p + out->len;
+    while ( p < end ) {
+      ssize_t n = write( out->fd, p, end - p );
+      if ( n < 0 && errno == EINTR )
+        continue;
+      if ( n <= 0 )
+        break;
+      p += n;
+    }
+    out->len = 0;
+  } else if ( out->fp ) {
+    fwrite( out->data, 1, out->len, out->fp );
+    out->len = 0;
+  }
+}
+
+void outputText( Output *out, char const *str, int len )
+{
+  if ( out->len + len > out->cap ) {
+    if ( out->fd >= 0 || out->fp )
+      flushOutput( out );
+
+    // Text bigger than the buffer, or output in memory, needs room.
+    if ( out->len + len > out->cap ) {
+      while ( out->len + len > out->cap )
+        out->cap *= 2;
+      out->data = (char *) realloc( out->data, out->cap );
+    }
+  }
+
+  memcpy( out->data + out->len, str, len );
+  out->len += len;
+  if ( out->unbuffered )
+    flushOutput( out );
+}
+
+void outputString( Output *out, char const *str )
+{
+  outputText( out, str, strlen( str ) );
+}
+
+void outputInt( Output *out, int64_t num )
+{
+  // Build the digits backward from the end of a small buffer.  Work
+  // with the magnitude as unsigned, so the smallest value is fine.
+  char buf[ MAX_DIGITS + 1 ];
+  char *p = buf + sizeof( buf );
+  uint64_t mag = num < 0 ? 0 - (uint64_t) num : (uint64_t) num;
+  do {
+    *--p = '0' + mag % 10;
+    mag /= 10;
+  } while ( mag );
+  if ( num < 0 )
+    *--p = '-';
+  outputText( out, p, buf + sizeof( buf ) - p );
+}
+
+void freeOutput( Output *out )
+{
+  flushOutput( out );
+  free( out->data );
+}
@@ -0,0 +1,91 @@
+/**
+  @file output.h
+  @author Prem Subedi
+  Buffer for the output of a running program, so printing doesn't go
+  through stdio for every print command.
+*/
+
+#ifndef _OUTPUT_H_
+#define _OUTPUT_H_
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Output from a program, collected in a buffer and written out in
+    large pieces.  It can go to a file descriptor, to a stdio stream,
+    or just stay in memory for the caller to use. */
+typedef struct {
+  /** Buffered output that hasn't been written yet. */
+  char *data;
+
+  /** Number of bytes in the buffer. */
+  int len;
+
+  /** Capacity of the buffer. */
+  int cap;
+
+  /** File descriptor to write to, or -1. */
+  int fd;
+
+  /** Stream to write to if there's no file descriptor, or NULL to
+      keep everything in memory. */
+  FILE *fp;
+
+  /** True if output should be written after every print, for
+      interactive use. */
+  bool unbuffered;
+} Output;
+
+/** Initialize output that's written to a file descriptor with write().
+    @param out Output to initialize.
+    @param fd file descriptor to write to.
+    @param unbuffered true to write after every print.
+*/
+void initOutput( Output *out, int fd, bool unbuffered );
+
+/** Initialize output that goes to a stdio stream.  If the stream has
+    a file descriptor, it's flushed, then the descriptor is written to
+    directly.
+    @param out Output to initialize.
+    @param fp stream to write to.
+*/
+void initStreamOutput( Output *out, FILE *fp );
+
+/** Initialize output that's kept in memory.  It's all in data when
+    the program is done.
+    @param out Output to initialize.
+*/
+void initMemoryOutput( Output *out );
+
+/** Add the given characters to the output.
+    @param out Output to add to.
+    @param str start of the characters.
+    @param len number of characters.
+*/
+void outputText( Output *out, char const *str, int len );
+
+/** Add a null terminated string to the output.
+    @param out Output to add to.
+    @param str string to add.
+*/
+void outputString( Output *out, char const *str );
+
+/** Add an integer to the output, in decimal.
+    @param out Output to add to.
+    @param num the integer.
+*/
+void outputInt( Output *out, int64_t num );
+
+/** Write out anything in the buffer.  For output kept in memory, this
+    does nothing.
+    @param out Output to flush.
+*/
+void flushOutput( Output *out );
+
+/** Flush the output, and free its buffer.
+    @param out Output to free.
+*/
+void freeOutput( Output *out );
+
+#endif
@@ -4,35 +4,84 @@
    This component contains the low-level parsing code for reading input scripts.
    It contains the function to extract individual tokens from the input,
    and supporting functions for reporting syntax errors, checking the current line number
-   and checking the format of a variable / label name.
+   and checking the format of a variable / label name.  The whole script
+   is mapped (or read) into memory up front, and tokens are views into
+   that text, so parsing doesn't make a library call per character.
  */
 
 #include "parse.h"
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-/** Current line we're parsing, starting from 1 like most editors. */
-static int lineCount = 1;
+/** Size of the blocks we read a script in, when it can't be mapped. */
+#define BLOCK_SIZE 65536
 
-int getLineNumber()
+bool openSource( Source *src, FILE *fp )
 {
-  return lineCount;
+  src->pos = 0;
+  src->line = 1;
+  src->mapped = false;
+
+  // For a regular file, just map it.  It's mapped privately and
+  // writable, so escape sequences can be decoded in place.
+  struct stat st;
+  int fd = fileno( fp );
+  if ( fstat( fd, &st ) == 0 && S_ISREG( st.st_mode ) && st.st_size > 0 ) {
+    void *text = mmap( NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0 );
+    if ( text != MAP_FAILED ) {
+      src->text = (char *) text;
+      src->length = st.st_size;
+      src->mapped = true;
+      return true;
+    }
+  }
+
+  // Otherwise, read it in big blocks.
+  long cap = BLOCK_SIZE;
+  src->length = 0;
+  src->text = (char *) malloc( cap );
+  size_t n;
+  while ( ( n = fread( src->text + src->length, 1, cap - src->length, fp ) ) > 0 ) {
+    src->length += n;
+    if ( src->length == cap ) {
+      cap *= 2;
+      src->text = (char *) realloc( src->text, cap );
+    }
+  }
+
+  return !ferror( fp );
 }
 
-void syntaxError()
+void closeSource( Source *src )
 {
-  fprintf( stderr, "Syntax error (line %d)\n", lineCount );
+  if ( src->mapped )
+    munmap( src->text, src->length );
+  else
+    free( src->text );
+}
+
+int getLineNumber( Source const *src )
+{
+  return src->line;
+}
+
+void syntaxError( Source const *src )
+{
+  fprintf( stderr, "Syntax error (line %d)\n", src->line );
   exit( EXIT_FAILURE );
 }
 
-bool isVarName( char const *str )
+bool isVarNameLen( char const *str, int len )
 {
-  for ( int i = 0; str[ i ]; i++ ) {
+  for ( int i = 0; i < len; i++ ) {
     // Character better be a letter, an underscore or a digit (and not
     // the first character).
-    if ( ! ( isalpha( str[ i ] ) || str[ i ] == '_' ||
-             ( i > 0 && isdigit( str[ i ] ) ) ) )
+    if ( ! ( isalpha( (unsigned char) str[ i ] ) || str[ i ] == '_' ||
+             ( i > 0 && isdigit( (unsigned char) str[ i ] ) ) ) )
       return false;
     if ( i >= MAX_VARNAME )
       return false;
@@ -41,64 +90,91 @@ bool isVarName( char const *str )
   return true;
 }
 
-bool parseToken( char *token, FILE *fp )
+bool isVarName( char const *str )
 {
-  int ch;
+  return isVarNameLen( str, strlen( str ) );
+}
+
+char const *tokenText( Source const *src, Token tok )
+{
+  return src->text + tok.offset;
+}
+
+bool tokenIs( Source const *src, Token tok, char const *str )
+{
+  return strncmp( src->text + tok.offset, str, tok.length ) == 0 &&
+    str[ tok.length ] == '\0';
+}
+
+bool parseToken( Source *src, Token *tok )
+{
+  char *text = src->text;
+  long end = src->length;
+  long pos = src->pos;
 
   // Skip whitespace and comments.
-  while ( isspace( ch = fgetc( fp ) ) || ch == '#' ) {
+  while ( pos < end && ( isspace( (unsigned char) text[ pos ] ) || text[ pos ] == '#' ) ) {
     // If we hit the comment characer, skip the whole line.
-    if ( ch == '#' )
-      while ( ( ch = fgetc( fp ) ) != EOF && ch != '\n' )
-        ;
+    if ( text[ pos ] == '#' )
+      while ( pos < end && text[ pos ] != '\n' )
+        pos++;
 
-    if ( ch == '\n' )
-      lineCount++;
+    if ( pos < end && text[ pos ] == '\n' )
+      src->line++;
+    pos++;
   }
 
-  if ( ch == EOF )
+  if ( pos >= end ) {
+    src->pos = end;
     return false;
+  }
 
-  // Record the character we've read and keep up with the token length.
-  int len = 0;
-  token[ len++ ] = ch;
+  // Record where the token starts and keep up with its length.
+  tok->offset = pos;
+  char ch = text[ pos++ ];
+  int len = 1;
 
   // Was that a command terminator?  If so, we're done.
   if ( ch == ';' ) {
-    token[ len++ ] = '\0';
+    tok->length = len;
+    src->pos = pos;
     return true;
   }
 
   // Handle non-quoted words.
   if ( ch != '"' ) {
-    while ( ( ch = fgetc( fp ) ) != EOF && !isspace( ch )
-            && ch != '"' && ch != '#' && ch != ';' ) {
+    while ( pos < end && !isspace( (unsigned char) text[ pos ] )
+            && text[ pos ] != '"' && text[ pos ] != '#' && text[ pos ] != ';' ) {
       // Complain if the token is too long.
       if ( len >= MAX_TOKEN )
-        syntaxError( lineCount );
+        syntaxError( src );
 
-      token[ len++ ] = ch;
+      pos++;
+      len++;
     }
 
-    // We had to read one character too far to find the end of the token.
-    // put it back.
-    if ( ch != EOF )
-      ungetc( ch, fp );
-
-    token[ len ] = '\0';
+    tok->length = len;
+    src->pos = pos;
     return true;
   }
 
-  // Most interesting case, handle strings.
+  // Most interesting case, handle strings.  Escape sequences are
+  // decoded in place, writing at out, which never gets ahead of pos.
+  long out = pos;
 
   // Is the next character escaped.
   bool escape = false;
 
   // Keep reading until we hit the matching close quote.
-  while ( ( ch = fgetc( fp ) ) != '"' || escape ) {
+  while ( true ) {
     // Error conditions
-    if ( ch == EOF || ch == '\n' )
-      syntaxError( lineCount );
+    if ( pos >= end )
+      syntaxError( src );
+    ch = text[ pos++ ];
+    if ( ch == '"' && !escape )
+      break;
+    if ( ch == '\n' )
+      syntaxError( src );
 
     // On a backslash, we just enable escape mode.
     if ( !escape && ch == '\\' ) {
@@ -120,41 +196,44 @@ bool parseToken( char *token, FILE *fp )
           ch = '\\';
           break;
         default:
-          syntaxError( lineCount );
+          syntaxError( src );
         }
         escape = false;
       }
 
       // Complain if this string, with the eventual close quote, is too long.
       if ( len + 1 >= MAX_TOKEN )
-        syntaxError( lineCount );
+        syntaxError( src );
 
-      token[ len++ ] = ch;
+      if ( out != pos - 1 )
+        text[ out ] = ch;
+      out++;
+      len++;
     }
   }
 
   // We leave off the closing quote, so it's easier to use just the content of a quoted string.
-  token[ len ] = '\0';
-  return token;
+  tok->length = len;
+  src->pos = pos;
+  return true;
 }
 
-void expectToken( char *tok, FILE *fp )
+void expectToken( Source *src, Token *tok )
 {
-  if ( !parseToken( tok, fp ) )
-    syntaxError();
+  if ( !parseToken( src, tok ) )
+    syntaxError( src );
 }
 
-void expectVariable( char *tok, FILE *fp )
+void expectVariable( Source *src, Token *tok )
 {
-  if ( !parseToken( tok, fp ) || ! isVarName( tok ) )
-    syntaxError();
+  if ( !parseToken( src, tok ) || ! isVarNameLen( tokenText( src, *tok ), tok->length ) )
+    syntaxError( src );
 }
 
-void requireToken( char const *target, FILE *fp )
+void requireToken( Source *src, char const *target )
 {
-  char tok[ MAX_TOKEN + 1 ];
-  expectToken( tok, fp );
-  if ( strcmp( tok, target ) != 0 )
-    syntaxError();
+  Token tok;
+  expectToken( src, &tok );
+  if ( !tokenIs( src, tok, target ) )
+    syntaxError( src );
 }
-
@@ -16,51 +16,120 @@
 /** Maximum length of a variable name or a label. */
 #define MAX_VARNAME 20
 
+/** A script being parsed.  The whole file is in memory, so tokens can
+    be found by scanning with a pointer instead of reading a character
+    at a time. */
+typedef struct {
+  /** Contents of the script. */
+  char *text;
+
+  /** Number of bytes in the script. */
+  long length;
+
+  /** Offset of the next character to read. */
+  long pos;
+
+  /** Current line we're parsing, starting from 1 like most editors. */
+  int line;
+
+  /** True if text is mapped from the file rather than allocated. */
+  bool mapped;
+} Source;
+
+/** A token, as a view of part of the source text.  Quoted strings
+    keep their leading double quote, but not the closing one, and their
+    escape sequences are decoded in place. */
+typedef struct {
+  /** Offset of the token's first character in the source text. */
+  long offset;
+
+  /** Number of characters in the token. */
+  int length;
+} Token;
+
+/** Read the whole contents of the given file into a Source, ready to
+    be tokenized.
+    @param src Source to initialize.
+    @param fp file to read.
+    @return true if the file was read successfully.
+*/
+bool openSource( Source *src, FILE *fp );
+
+/** Free the memory used for the text of a Source.
+    @param src Source to close.
+*/
+void closeSource( Source *src );
+
 /** Return the current line number in the input (for error messages).
+    @param src Source being parsed.
     @return Line number in the input.
 */
-int getLineNumber();
+int getLineNumber( Source const *src );
 
-/** Print a syntax error message, with a line number and exit. */
-void syntaxError();
+/** Print a syntax error message, with a line number and exit.
+    @param src Source being parsed.
+*/
+void syntaxError( Source const *src );
 
 /** Return true if the given string is a legal variable name.
+    @param str string to check.
     @return True if it's a legal variable name.
 */
 bool isVarName( char const *str );
 
-/** Read the next token from the given file, a space-delimtied word, a
+/** Return true if the first len characters of str are a legal
+    variable name.
+    @param str start of the characters to check.
+    @param len number of characters to check.
+    @return True if it's a legal variable name.
+*/
+bool isVarNameLen( char const *str, int len );
+
+/** Return a pointer to the first character of a token.  The token
+    isn't null terminated, its length is in the token.
+    @param src Source the token came from.
+    @param tok the token.
+    @return pointer to the token's text.
+*/
+char const *tokenText( Source const *src, Token tok );
+
+/** Return true if the given token is exactly the given string.
+    @param src Source the token came from.
+    @param tok the token.
+    @param str string to compare against.
+    @return true if they match.
+*/
+bool tokenIs( Source const *src, Token tok, char const *str );
+
+/** Read the next token from the given source, a space-delimtied word, a
     double quoted string or closing parentheses, crly brackets or a
     semi-colon.  For double-quoted strings, it removes the final
     double quote, but leaves the one at the start.
-    @param tok storage for the token, with room for a string of up to
-     MAX_TOKEN characters.
-    @param fp file to read tokens from.
+    @param src Source to read tokens from.
+    @param tok storage for the view of the token.
     @return true if the token is successfully read.
 */
-bool parseToken( char *token, FILE *fp );
+bool parseToken( Source *src, Token *tok );
 
 /** Called when we expect another token on the input.  This function
     parses the token and exits with an error if there isn't one.
-    @param storage for the next token, with capacity for at least
-    MAX_TOKEN characters.
-    @param fp file tokens should be read from.
+    @param src Source tokens should be read from.
+    @param tok storage for the view of the next token.
 */
-void expectToken( char *tok, FILE *fp );
+void expectToken( Source *src, Token *tok );
 
 /** Called when there needs to be a next token, and it needs to be a legal
     variable name.  Prints the syntax error message if it's not.
-    @param storage for the next token, with capacity for at least
-    MAX_TOKEN characters.
-    @param fp file tokens should be read from.
+    @param src Source tokens should be read from.
+    @param tok storage for the view of the next token.
 */
-void expectVariable( char *tok, FILE *fp );
+void expectVariable( Source *src, Token *tok );
 
 /** Called when the next token, must be a particular value,
     target.  Prints an error message and exits if it's not.
+    @param src Source tokens should be read from.
     @param target string that the next token should match.
-    @param fp file tokens should be read from.
 */
-void requireToken( char const *target, FILE *fp );
+void requireToken( Source *src, char const *target );
 
 #endif
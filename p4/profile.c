@@ -0,0 +1,129 @@
+/**
+   @file profile.c
+   @author Prem Subedi
+   This component turns the per-instruction counters collected while a
+   script runs into a report by source line and by basic block.
+ */
+
+#include "profile.h"
+#include <stdlib.h>
+
+/** Number of source lines to show in the hot-line report. */
+#define HOT_LINES 20
+
+/** Totals for one source line, or one basic block. */
+typedef struct {
+  /** Source line, or index of the block. */
+  int key;
+
+  /** Number of instructions run. */
+  long count;
+
+  /** Time spent running them. */
+  unsigned long long cycles;
+} Totals;
+
+/**
+   Comparison function for sorting totals, most time first.
+   @param a pointer to the first Totals.
+   @param b pointer to the second Totals.
+   @return negative, zero or positive, like strcmp().
+*/
+static int byCycles( void const *a, void const *b )
+{
+  Totals const *ta = (Totals const *) a;
+  Totals const *tb = (Totals const *) b;
+  if ( ta->cycles != tb->cycles )
+    return ta->cycles > tb->cycles ? -1 : 1;
+  return ta->key - tb->key;
+}
+
+/**
+   Comparison function for sorting blocks in source order.
+   @param a pointer to the first BlockStart.
+   @param b pointer to the second BlockStart.
+   @return negative, zero or positive, like strcmp().
+*/
+static int byLine( void const *a, void const *b )
+{
+  return ( (BlockStart const *) a )->line - ( (BlockStart const *) b )->line;
+}
+
+/**
+   Return the percentage of the total that the given part is.
+   @param part the part.
+   @param total the total.
+   @return the percentage.
+*/
+static double percent( unsigned long long part, unsigned long long total )
+{
+  return total ? 100.0 * part / total : 0.0;
+}
+
+void initProfile( Profile *prof, Code const *code )
+{
+  prof->count = (long *) calloc( code->count + 1, sizeof( long ) );
+  prof->cycles = (unsigned long long *) calloc( code->count + 1, sizeof( unsigned long long ) );
+}
+
+void reportProfile( Profile const *prof, Code const *code,
+                    BlockStart *blocks, int nblocks, FILE *fp )
+{
+  long total = 0;
+  unsigned long long totalCycles = 0;
+  int maxLine = 0;
+  for ( int i = 0; i < code->count; i++ ) {
+    total += prof->count[ i ];
+    totalCycles += prof->cycles[ i ];
+    if ( code->instr[ i ].line > maxLine )
+      maxLine = code->instr[ i ].line;
+  }
+
+  fprintf( fp, "Profile: %ld instructions, %llu cycles\n", total, totalCycles );
+
+  // Add up the counts for each source line, then show the hottest ones.
+  Totals *lines = (Totals *) calloc( maxLine + 1, sizeof( Totals ) );
+  for ( int i = 0; i <= maxLine; i++ )
+    lines[ i ].key = i;
+  for ( int i = 0; i < code->count; i++ ) {
+    lines[ code->instr[ i ].line ].count += prof->count[ i ];
+    lines[ code->instr[ i ].line ].cycles += prof->cycles[ i ];
+  }
+  qsort( lines, maxLine + 1, sizeof( Totals ), byCycles );
+
+  fprintf( fp, "\n%6s %12s %16s %8s\n", "line", "count", "cycles", "percent" );
+  for ( int i = 0; i <= maxLine && i < HOT_LINES && lines[ i ].count > 0; i++ )
+    fprintf( fp, "%6d %12ld %16llu %7.2f%%\n", lines[ i ].key, lines[ i ].count,
+             lines[ i ].cycles, percent( lines[ i ].cycles, totalCycles ) );
+  free( lines );
+
+  // Each instruction belongs to the last block that starts at or
+  // before its line.  Block 0 is the code before the first label.
+  qsort( blocks, nblocks, sizeof( BlockStart ), byLine );
+  Totals *sums = (Totals *) calloc( nblocks + 1, sizeof( Totals ) );
+  for ( int i = 0; i < code->count; i++ ) {
+    int lo = 0, hi = nblocks;
+    while ( lo < hi ) {
+      int mid = ( lo + hi ) / 2;
+      if ( blocks[ mid ].line <= code->instr[ i ].line )
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    sums[ lo ].count += prof->count[ i ];
+    sums[ lo ].cycles += prof->cycles[ i ];
+  }
+
+  fprintf( fp, "\n%-22s %12s %16s %8s\n", "block", "count", "cycles", "percent" );
+  for ( int b = 0; b <= nblocks; b++ )
+    if ( sums[ b ].count > 0 )
+      fprintf( fp, "%-22s %12ld %16llu %7.2f%%\n", b ? blocks[ b - 1 ].name : "(start)",
+               sums[ b ].count, sums[ b ].cycles, percent( sums[ b ].cycles, totalCycles ) );
+  free( sums );
+}
+
+void freeProfile( Profile *prof )
+{
+  free( prof->count );
+  free( prof->cycles );
+}
@@ -0,0 +1,45 @@
+/**
+  @file profile.h
+  @author Prem Subedi
+  Reporting for the counters collected when a script is profiled.
+*/
+
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+#include <stdio.h>
+#include "bytecode.h"
+
+/** Start of a basic block in the source, for the per-label summary. */
+typedef struct {
+  /** Name of the label at the start of the block. */
+  char const *name;
+
+  /** Source line of the first command after the label. */
+  int line;
+} BlockStart;
+
+/** Allocate zeroed profiling counters for a compiled program.
+    @param prof Profile to initialize.
+    @param code Compiled program that will be profiled.
+*/
+void initProfile( Profile *prof, Code const *code );
+
+/** Print a report of where a profiled program spent its time.  There
+    are two parts, the hottest source lines, and a summary for each
+    basic block, the code from one label up to the next.
+    @param prof Counters filled in by runCode().
+    @param code Compiled program that was profiled.
+    @param blocks Starts of all the basic blocks, in any order.
+    @param nblocks Number of blocks.
+    @param fp Stream to print the report to.
+*/
+void reportProfile( Profile const *prof, Code const *code,
+                    BlockStart *blocks, int nblocks, FILE *fp );
+
+/** Free the memory for profiling counters.
+    @param prof Profile to free.
+*/
+void freeProfile( Profile *prof );
+
+#endif
@@ -0,0 +1,136 @@
+/**
+   @file program.c
+   @author Prem Subedi
+   This component loads a whole script into a program, compiles it,
+   and runs it.  It's the top of the nonde library, the part that
+   programs embedding the runtime call.
+ */
+
+#include "program.h"
+#include <stdlib.h>
+#include <sys/mman.h>
+#include "parse.h"
+#include "optimize.h"
+
+/** Initial capacity for resizable arrays. */
+#define INITIAL_CAPACITY 5
+
+/** Growth rate (multiplier) for resizable arrays. */
+#define GROWTH_RATE 2
+
+/** Initialize the given Program structure and read in the program
+    definition from the given file.
+    @param prog Program structure to populate.
+    @param fp File to read from.
+    @return true if the file could be read.
+*/
+static bool loadProgram( NondeProgram *prog, FILE *fp )
+{
+  // Initialize the array of command pointers.
+  prog->count = 0;
+  prog->cap = INITIAL_CAPACITY;
+  prog->cmd = (Command **) malloc( prog->cap * sizeof( Command * ) );
+
+  // Initialize the labelMap structure in the program.
+  initMap( &prog->labelMap );
+  initArena( &prog->arena );
+  initVars( &prog->vars, &prog->arena );
+  prog->code.instr = NULL;
+  prog->cmdLine = NULL;
+  prog->image = NULL;
+
+  // Bring the whole script into memory, so it can be tokenized in place.
+  Source src;
+  if ( !openSource( &src, fp ) )
+    return false;
+
+  // Hash the text before tokenizing it, which changes it in place.
+  prog->sourceHash = hashSource( src.text, src.length );
+
+  // One token of read-ahead, so we can tell what's next in the program.
+  Token tok;
+  while ( parseToken( &src, &tok ) ) {
+
+    // Is this token a label?
+    char const *text = tokenText( &src, tok );
+    if ( text[ tok.length - 1 ] == ':' ) {
+      // Throw away the : at the end, and put it in the map.
+      if ( !isVarNameLen( text, tok.length - 1 ) )
+        syntaxError( &src );
+      addLabelLen( &prog->labelMap, text, tok.length - 1, prog->count );
+    } else {
+      // If it's not a label, it must be a command.
+      Command *cmd = parseCommand( tok, &src, &prog->vars, &prog->arena );
+
+      // Enlarge the command list if needed, and store the new command.
+      if ( prog->count >= prog->cap ) {
+        prog->cap *= GROWTH_RATE;
+        prog->cmd = (Command **) realloc( prog->cmd, prog->cap * sizeof( Command * ) );
+      }
+      prog->cmd[ prog->count ++ ] = cmd;
+    }
+  }
+
+  // Everything we need from the text has been copied into the program.
+  closeSource( &src );
+  return true;
+}
+
+/** Compile a loaded program into a flat array of instructions, with
+    the targets of all the if and goto commands resolved.
+    @param prog Program to compile.
+*/
+static void compileProgram( NondeProgram *prog )
+{
+  Code *code = &prog->code;
+  code->count = prog->count;
+  code->vars = &prog->vars;
+  code->checkOverflow = false;
+  code->trace = true;
+  code->instr = (Instr *) calloc( prog->count ? prog->count : 1, sizeof( Instr ) );
+  for ( int i = 0; i < prog->count; i++ )
+    prog->cmd[ i ]->compile( prog->cmd[ i ], code->instr + i, &prog->labelMap, &prog->vars );
+}
+
+NondeProgram *nondeCompile( FILE *fp, int flags )
+{
+  NondeProgram *prog = (NondeProgram *) malloc( sizeof( NondeProgram ) );
+  if ( !loadProgram( prog, fp ) ) {
+    nondeFree( prog );
+    return NULL;
+  }
+
+  compileProgram( prog );
+  if ( flags & NONDE_OPTIMIZE )
+    optimizeCode( &prog->code, &prog->vars );
+  prog->code.checkOverflow = ( flags & NONDE_CHECK_OVERFLOW ) != 0;
+  prog->code.trace = ( flags & NONDE_NO_TRACE ) == 0;
+  prog->flags = flags;
+  return prog;
+}
+
+int nondeRun( NondeProgram const *prog, char const *const *bindings, FILE *out, FILE *err )
+{
+  Output output;
+  initStreamOutput( &output, out );
+  int status = runCode( &prog->code, bindings, &output, err, NULL );
+  freeOutput( &output );
+  return status;
+}
+
+void nondeFree( NondeProgram *prog )
+{
+  if ( !prog ) return;
+
+  // The commands themselves are all in the arena, and for a program
+  // from an image, the instructions are in the image.
+  if ( prog->image )
+    munmap( prog->image, prog->imageSize );
+  else
+    free( prog->code.instr );
+  freeArena( &prog->arena );
+  freeMap( &prog->labelMap );
+  freeVars( &prog->vars );
+  free( prog->cmd );
+  free( prog );
+}
@@ -0,0 +1,72 @@
+/**
+  @file program.h
+  @author Prem Subedi
+  Representation of a whole compiled program, shared by the parts of
+  the library and by the nonde command, which needs more access to it
+  than the public interface gives.
+*/
+
+#ifndef _PROGRAM_H_
+#define _PROGRAM_H_
+
+#include "nonde.h"
+#include "command.h"
+#include "label.h"
+#include "value.h"
+#include "bytecode.h"
+#include "arena.h"
+#include <stdint.h>
+#include <stddef.h>
+
+/** Type used to represent a whole program, including a list of commands,
+    a record of where all the labels are, and the compiled instructions. */
+struct NondeProgramStruct {
+  /** Sequence of all the commands in the program. */
+  Command **cmd;
+
+  /** Number of commands in the program. */
+  int count;
+
+  /** Capacity of the command list, free resize behavior. */
+  int cap;
+
+  /** Label map, for the targets of if and goto. */
+  LabelMap labelMap;
+
+  /** Slots for all the variables and literals used in the program. */
+  VarTable vars;
+
+  /** Storage for the commands and the names and literals they use,
+      so they're next to each other in memory and freed all at once. */
+  Arena arena;
+
+  /** The program compiled to bytecode, ready to run. */
+  Code code;
+
+  /** Flags the program was compiled with. */
+  int flags;
+
+  /** Hash of the text of the script, for checking images. */
+  uint64_t sourceHash;
+
+  /** For a program loaded from an image, which has no commands, the
+      source line of each command.  Otherwise, NULL. */
+  int const *cmdLine;
+
+  /** For a program loaded from an image, the mapped image, which the
+      instructions, names and literals all point into.  Otherwise, NULL. */
+  void *image;
+
+  /** Size of the mapped image. */
+  size_t imageSize;
+};
+
+/** Compute the hash of a script's text, that images are checked
+    against to see if they're out of date.
+    @param text contents of the script.
+    @param len number of bytes in the script.
+    @return hash of the script.
+*/
+uint64_t hashSource( char const *text, long len );
+
+#endif
@@ -0,0 +1,88 @@
+/**
+   @file runbench.c
+   @author Prem Subedi
+   Benchmark for running the same script many times through the nonde
+   library.  It times compiling the script for every run, like invoking
+   nonde once per input, against compiling it once and reusing it, and
+   reports runs per second for each.  The variable N is bound to the
+   number of the run, so each run gets different input.  Output from
+   the script goes to standard output, and the report to standard
+   error, so the output can be thrown away.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "nonde.h"
+
+/** Number of runs if none is given on the command line. */
+#define DEFAULT_RUNS 10000
+
+/** Return the current time in seconds, from a monotonic clock.
+    @return current time.
+*/
+static double now()
+{
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** Compile the script in the given file, exiting if it can't be read.
+    @param path name of the script file.
+    @return the compiled program.
+*/
+static NondeProgram *compileFile( char const *path )
+{
+  FILE *fp = fopen( path, "r" );
+  NondeProgram *prog = fp ? nondeCompile( fp, NONDE_OPTIMIZE ) : NULL;
+  if ( fp )
+    fclose( fp );
+  if ( !prog ) {
+    fprintf( stderr, "Can't read file: %s\n", path );
+    exit( EXIT_FAILURE );
+  }
+  return prog;
+}
+
+/** Starting point for the benchmark.
+    @param argc number of command-line arguments
+    @param argv array of command-line arguments
+    @return exit status
+*/
+int main( int argc, char *argv[] )
+{
+  if ( argc < 2 || argc > 3 ) {
+    fprintf( stderr, "usage: runbench <script> [runs]\n" );
+    exit( EXIT_FAILURE );
+  }
+  int n = argc > 2 ? atoi( argv[ 2 ] ) : DEFAULT_RUNS;
+
+  char binding[ 32 ];
+  char const *bindings[] = { binding, NULL };
+
+  // Compile the script again for every run.
+  double start = now();
+  for ( int i = 0; i < n; i++ ) {
+    NondeProgram *prog = compileFile( argv[ 1 ] );
+    snprintf( binding, sizeof( binding ), "N=%d", i );
+    nondeRun( prog, bindings, stdout, stderr );
+    nondeFree( prog );
+  }
+  double each = now() - start;
+
+  // Compile it once, and run it n times.
+  start = now();
+  NondeProgram *prog = compileFile( argv[ 1 ] );
+  for ( int i = 0; i < n; i++ ) {
+    snprintf( binding, sizeof( binding ), "N=%d", i );
+    nondeRun( prog, bindings, stdout, stderr );
+  }
+  nondeFree( prog );
+  double once = now() - start;
+
+  fflush( stdout );
+  fprintf( stderr, "%d runs: compile each run %.0f runs/s, compile once %.0f runs/s\n",
+           n, n / each, n / once );
+  return EXIT_SUCCESS;
+}
@@ -6,11 +6,13 @@ FAIL=0
 testNonde() {
   TESTNO=$1
   ESTATUS=$2
+  FLAGS=$3
+  SCRIPT=${4:-script-$TESTNO.txt}
 
   rm -f output.txt stderr.txt
 
-  echo "Test $TESTNO: ./nonde script-$TESTNO.txt > output.txt 2> stderr.txt"
-  ./nonde script-$TESTNO.txt > output.txt 2> stderr.txt
+  echo "Test $TESTNO: ./nonde $FLAGS $SCRIPT > output.txt 2> stderr.txt"
+  ./nonde $FLAGS $SCRIPT > output.txt 2> stderr.txt
   STATUS=$?
 
   # Make sure the program exited with the right exit status.
@@ -71,6 +73,71 @@ if [ -x nonde ] ; then
     testNonde 19 1
     testNonde 20 1
     testNonde 21 1
+    testNonde 22 0
+    testNonde 23 1 --check-overflow
+
+    # Batch runs, their output has to come back in input order.
+    testNonde 24 1 "--batch inputs-24.txt -j 4"
+    testNonde 24 1 "--batch inputs-24.txt -j 1"
+
+    # Hot loops run as traces, they have to leave the trace for
+    # anything they weren't recorded for.
+    testNonde 25 1
+    testNonde 25 1 --no-trace
+
+    # String commands, with long strings built up in a traced loop.
+    testNonde 26 1
+    testNonde 26 1 --no-trace
+
+    # Output written after every print has to be the same.
+    testNonde 14 0 --unbuffered
+    testNonde 25 1 --unbuffered
+
+    # Runs from a cached image have to match the script.  The first
+    # run of each pair saves the image, and the second one loads it.
+    rm -f cache.img
+    for FLAGS in "--cache cache.img" "-O --cache cache.img" ; do
+      testNonde 14 0 "$FLAGS"
+      testNonde 14 0 "$FLAGS"
+      testNonde 22 0 "$FLAGS"
+      testNonde 22 0 "$FLAGS"
+      testNonde 25 1 "$FLAGS"
+      testNonde 25 1 "$FLAGS"
+      testNonde 26 1 "$FLAGS"
+      testNonde 26 1 "$FLAGS"
+    done
+    testNonde 24 1 "--cache cache.img --batch inputs-24.txt -j 2"
+    testNonde 24 1 "--cache cache.img --batch inputs-24.txt -j 2"
+
+    # A script from a pipe can't be rewound after it's checked against
+    # the image, but it still has to run.
+    rm -f cache.img
+    testNonde 01 0 "--cache cache.img" <(cat script-01.txt)
+    testNonde 01 0 "--cache cache.img" <(cat script-01.txt)
+    testNonde 14 0 "--cache cache.img" <(cat script-14.txt)
+    rm -f cache.img
+
+    # The optimizer shouldn't change what any script does.
+    for TESTNO in 01 02 03 04 05 06 07 08 09 10 11 12 13 14 15 22 ; do
+      testNonde $TESTNO 0 -O
+    done
+    for TESTNO in 16 17 18 19 20 21 ; do
+      testNonde $TESTNO 1 -O
+    done
+    testNonde 23 1 "-O --check-overflow"
+    testNonde 24 1 "-O --batch inputs-24.txt -j 4"
+    testNonde 25 1 -O
+    testNonde 26 1 -O
+
+    # Neither should profiling, its report goes to stderr.
+    for TESTNO in 01 02 03 04 05 06 07 08 09 10 11 12 13 14 15 ; do
+      testNonde $TESTNO 0 --profile
+    done
+
+    # Or turning off tracing.
+    for TESTNO in 01 02 03 04 05 06 07 08 09 10 11 12 13 14 15 22 ; do
+      testNonde $TESTNO 0 --no-trace
+    done
 else
     echo "**** Your program didn't compile successfully, so we couldn't test it."
     FAIL=1
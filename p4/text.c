@@ -0,0 +1,182 @@
+/**
+   @file text.c
+   @author Prem Subedi
+   This component implements the string commands.  Short results are
+   stored right in the value.  Longer ones go in reference-counted
+   storage that's never changed once it's written, so copying a value
+   or taking part of one just shares the storage, and appending to the
+   end of a string adds to the storage instead of copying it.
+ */
+
+#include "text.h"
+#include <limits.h>
+
+/** Enough room for the text of any 64-bit integer. */
+#define INT_TEXT 21
+
+/** Longest string we'll make, so sizes always fit in an int. */
+#define MAX_STRING ( INT_MAX / 2 )
+
+/** Smallest storage to allocate for a shared string. */
+#define MIN_CAP 32
+
+/**
+   Return the text of a value, formatting it first if it's an integer.
+   @param v value, which can't be undefined.
+   @param buf room to format an integer, at least INT_TEXT characters.
+   @param len storage for the number of characters.
+   @return start of the text.
+*/
+static char const *valueText( Value const *v, char *buf, int *len )
+{
+  if ( v->type != VAL_INT )
+    return stringText( v, len );
+
+  // Build the digits backward from the end of the buffer.
+  char *p = buf + INT_TEXT;
+  uint64_t mag = v->num < 0 ? 0 - (uint64_t) v->num : (uint64_t) v->num;
+  do {
+    *--p = '0' + mag % 10;
+    mag /= 10;
+  } while ( mag );
+  if ( v->num < 0 )
+    *--p = '-';
+  *len = buf + INT_TEXT - p;
+  return p;
+}
+
+/**
+   Make a string value using new shared storage.
+   @param r value to fill in.
+   @param len number of characters the value will have.
+   @param cap number of characters to make room for, at least len.
+   @return start of the storage, for the caller to copy the text to.
+*/
+static char *makeShared( Value *r, int len, int cap )
+{
+  StrBuf *buf = (StrBuf *) malloc( sizeof( StrBuf ) + cap );
+  buf->refs = 1;
+  buf->used = len;
+  buf->cap = cap;
+  r->type = VAL_SHARED;
+  r->text.shared.buf = buf;
+  r->text.shared.start = 0;
+  r->text.shared.len = len;
+  return buf->data;
+}
+
+/**
+   Make a string value with inline storage.
+   @param r value to fill in.
+   @param len number of characters, at most SMALL_STRING.
+   @return start of the storage, for the caller to copy the text to.
+*/
+static char *makeSmall( Value *r, int len )
+{
+  r->type = VAL_SMALL;
+  r->smallLen = len;
+  r->text.small[ len ] = '\0';
+  return r->text.small;
+}
+
+/**
+   Work out the number a new string starts with, then store it.  This
+   is done last, since the old value may hold the source text.
+   @param dest value to overwrite.
+   @param r the new string, which already has its own reference to
+   any shared storage.
+*/
+static void storeText( Value *dest, Value *r )
+{
+  int len;
+  char const *text = stringText( r, &len );
+  r->numeric = parseNumber( text, len, &r->num );
+  dropValue( dest );
+  *dest = *r;
+}
+
+bool concatValues( Value *dest, Value const *a, Value const *b )
+{
+  char abuf[ INT_TEXT ], bbuf[ INT_TEXT ];
+  int alen, blen;
+  char const *atext = valueText( a, abuf, &alen );
+  char const *btext = valueText( b, bbuf, &blen );
+  if ( blen > MAX_STRING - alen )
+    return false;
+  int len = alen + blen;
+
+  Value r;
+  if ( a->type == VAL_SHARED ) {
+    // If a ends where the storage's text ends, b can go right after it
+    // without changing anything another value can see.
+    StrBuf *buf = a->text.shared.buf;
+    if ( a->text.shared.start + alen == buf->used && buf->cap - buf->used >= blen ) {
+      memcpy( buf->data + buf->used, btext, blen );
+      buf->used += blen;
+      buf->refs++;
+      r = *a;
+      r.text.shared.len = len;
+      storeText( dest, &r );
+      return true;
+    }
+  }
+
+  // Leave room to append, so a string built up a piece at a time is
+  // only copied when its storage fills up.
+  char *data = len <= SMALL_STRING ? makeSmall( &r, len )
+    : makeShared( &r, len, len < MAX_STRING / 2 ? len * 2 : MAX_STRING );
+  memcpy( data, atext, alen );
+  memcpy( data + alen, btext, blen );
+  storeText( dest, &r );
+  return true;
+}
+
+void lengthValue( Value *dest, Value const *a )
+{
+  char buf[ INT_TEXT ];
+  int len;
+  valueText( a, buf, &len );
+  storeInt( dest, len );
+}
+
+void substrValue( Value *dest, Value const *a, int64_t start, int64_t count )
+{
+  char buf[ INT_TEXT ];
+  int alen;
+  char const *text = valueText( a, buf, &alen );
+  if ( start < 0 )
+    start = 0;
+  if ( start > alen )
+    start = alen;
+  if ( count < 0 )
+    count = 0;
+  if ( count > alen - start )
+    count = alen - start;
+  int len = count;
+
+  Value r;
+  if ( len <= SMALL_STRING ) {
+    memcpy( makeSmall( &r, len ), text + start, len );
+  } else if ( a->type == VAL_SHARED ) {
+    // A long part of shared text can just share it.
+    r = *a;
+    r.text.shared.start += start;
+    r.text.shared.len = len;
+    r.text.shared.buf->refs++;
+  } else {
+    memcpy( makeShared( &r, len, len ), text + start, len );
+  }
+  storeText( dest, &r );
+}
+
+void compareValues( Value *dest, Value const *a, Value const *b )
+{
+  char abuf[ INT_TEXT ], bbuf[ INT_TEXT ];
+  int alen, blen;
+  char const *atext = valueText( a, abuf, &alen );
+  char const *btext = valueText( b, bbuf, &blen );
+  int diff = memcmp( atext, btext, alen < blen ? alen : blen );
+  if ( diff == 0 )
+    diff = alen - blen;
+  storeInt( dest, diff < 0 ? -1 : diff > 0 );
+}
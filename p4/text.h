@@ -0,0 +1,49 @@
+/**
+  @file text.h
+  @author Prem Subedi
+  Operations on the text of values, for the string commands.
+*/
+
+#ifndef _TEXT_H_
+#define _TEXT_H_
+
+#include "value.h"
+
+/** Store the text of one value followed by the text of another.  If
+    the first one ends at the end of the storage it shares, and
+    there's room, the second is added right after it, so building up
+    a string in a loop doesn't copy it every time.  The result is
+    numeric if its text starts with an integer.
+    @param dest value to store the result in, which can be a source.
+    @param a value for the start of the text, which can't be undefined.
+    @param b value for the rest of the text, which can't be undefined.
+    @return false if the result would be too long to store.
+*/
+bool concatValues( Value *dest, Value const *a, Value const *b );
+
+/** Store the number of characters in a value's text.
+    @param dest value to store the length in.
+    @param a value to measure, which can't be undefined.
+*/
+void lengthValue( Value *dest, Value const *a );
+
+/** Store part of a value's text.  The part is clipped to the text, so
+    it's empty if it starts past the end, or the count isn't positive.
+    A long part shares storage with the text it came from.
+    @param dest value to store the result in, which can be the source.
+    @param a value to take the part from, which can't be undefined.
+    @param start index of the first character of the part, from 0.
+    @param count number of characters in the part.
+*/
+void substrValue( Value *dest, Value const *a, int64_t start, int64_t count );
+
+/** Compare the text of two values, character by character, and store
+    -1, 0 or 1 depending on whether the first comes before, is the
+    same as, or comes after the second.
+    @param dest value to store the result in.
+    @param a first value, which can't be undefined.
+    @param b second value, which can't be undefined.
+*/
+void compareValues( Value *dest, Value const *a, Value const *b );
+
+#endif
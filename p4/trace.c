@@ -0,0 +1,233 @@
+/**
+   @file trace.c
+   @author Prem Subedi
+   This component turns the path the interpreter took around a hot
+   loop into a trace, and runs it.  A trace is a list of operations
+   with pointers straight to the values they use, and no gotos.  Each
+   branch becomes a check that it goes the same way it did when the
+   trace was recorded.  Running one only needs the interpreter again
+   when something unusual happens, like a branch that goes the other
+   way, an operand that isn't a number or a runtime error.
+ */
+
+#include "trace.h"
+#include "text.h"
+#include <stdlib.h>
+
+/** Number of times a trace has to be entered before we decide if
+    it's useful. */
+#define TRIAL_ENTRIES 32
+
+/** One operation in a trace, compiled from one instruction. */
+typedef struct {
+  /** Operation to perform, the same as the instruction's. */
+  Opcode op;
+
+  /** For a branch, true if it jumped when the trace was recorded. */
+  bool taken;
+
+  /** Index of the instruction, to go back to if this operation can't
+      be run in the trace. */
+  int pc;
+
+  /** For a branch, where to go if it doesn't go the recorded way. */
+  int exit;
+
+  /** Destination value. */
+  Value *dst;
+
+  /** Source values. */
+  Value const *a;
+  Value const *b;
+
+  /** For divmod the destination for the remainder, and for substr
+      the number of characters to take. */
+  Value *c;
+} TraceOp;
+
+struct TraceStruct {
+  /** Operations, in the order they run. */
+  TraceOp *ops;
+
+  /** Number of operations. */
+  int count;
+
+  /** True if overflow should leave the trace, to be reported. */
+  bool checkOverflow;
+
+  /** Number of times the trace was run, and the number of times it
+      got all the way around the loop. */
+  long entries;
+  long loops;
+};
+
+Trace *compileTrace( Code const *code, Value *frame, TraceStep const *steps, int n )
+{
+  Trace *trace = (Trace *) malloc( sizeof( Trace ) );
+  trace->ops = (TraceOp *) malloc( ( n + 1 ) * sizeof( TraceOp ) );
+  trace->count = 0;
+  trace->checkOverflow = code->checkOverflow;
+  trace->entries = trace->loops = 0;
+
+  for ( int i = 0; i < n; i++ ) {
+    int pc = steps[ i ].pc;
+    Instr const *in = code->instr + pc;
+
+    // A goto always goes the same way, so it doesn't need anything.
+    if ( in->op == OP_GOTO )
+      continue;
+
+    TraceOp *op = trace->ops + trace->count++;
+    op->op = in->op;
+    op->pc = pc;
+    op->dst = frame + in->arg[ 0 ];
+    op->c = in->op == OP_DIVMOD || in->op == OP_SUBSTR ? frame + in->arg[ 3 ] : NULL;
+    op->a = frame + in->arg[ 1 ];
+    op->b = frame + in->arg[ 2 ];
+
+    if ( in->op == OP_IF ) {
+      op->a = frame + in->arg[ 0 ];
+      op->taken = steps[ i ].next != pc + 1;
+
+      // If the label isn't defined, let the interpreter report it.
+      op->exit = op->taken ? pc + 1 : in->target >= 0 ? in->target : pc;
+    } else if ( in->op == OP_JEQ || in->op == OP_JLESS ) {
+      op->taken = steps[ i ].next != pc + 1;
+      op->exit = op->taken ? pc + 1 : in->target;
+    } else if ( in->op == OP_PRINT ) {
+      op->a = frame + in->arg[ 0 ];
+    }
+  }
+
+  return trace;
+}
+
+int runTrace( Trace *trace, Output *out )
+{
+  TraceOp const *ops = trace->ops;
+  TraceOp const *end = ops + trace->count;
+  bool check = trace->checkOverflow;
+  trace->entries++;
+
+  for ( ;; trace->loops++ ) {
+    for ( TraceOp const *op = ops; op < end; op++ ) {
+      Value const *a = op->a;
+      Value const *b = op->b;
+      switch ( op->op ) {
+      case OP_PRINT:
+        if ( a->type == VAL_UNDEF )
+          return op->pc;
+        if ( a->type == VAL_INT )
+          outputInt( out, a->num );
+        else {
+          int len;
+          char const *text = stringText( a, &len );
+          outputText( out, text, len );
+        }
+        continue;
+
+      case OP_SET:
+        if ( a->type == VAL_UNDEF )
+          return op->pc;
+        copyValue( op->dst, a );
+        continue;
+
+      case OP_LENGTH:
+        if ( a->type == VAL_UNDEF )
+          return op->pc;
+        lengthValue( op->dst, a );
+        continue;
+
+      case OP_SUBSTR:
+        if ( a->type == VAL_UNDEF || !b->numeric || !op->c->numeric )
+          return op->pc;
+        substrValue( op->dst, a, b->num, op->c->num );
+        continue;
+
+      case OP_CONCAT:
+        if ( a->type == VAL_UNDEF || b->type == VAL_UNDEF || !concatValues( op->dst, a, b ) )
+          return op->pc;
+        continue;
+
+      case OP_COMPARE:
+        if ( a->type == VAL_UNDEF || b->type == VAL_UNDEF )
+          return op->pc;
+        compareValues( op->dst, a, b );
+        continue;
+
+      case OP_IF:
+        if ( a->type == VAL_UNDEF )
+          return op->pc;
+        if ( ( a->numeric && a->num ) != op->taken )
+          return op->exit;
+        continue;
+
+      default:
+        break;
+      }
+
+      // Everything else needs two numbers.  Undefined values aren't
+      // numeric, so this check covers them too.
+      if ( !a->numeric || !b->numeric )
+        return op->pc;
+
+      int64_t ans;
+      bool ok = true;
+      switch ( op->op ) {
+      case OP_EQ:
+        copyValue( op->dst, a->num == b->num ? &trueValue : &falseValue );
+        continue;
+      case OP_LESS:
+        copyValue( op->dst, a->num < b->num ? &trueValue : &falseValue );
+        continue;
+      case OP_JEQ:
+      case OP_JLESS:
+        ok = op->op == OP_JEQ ? a->num == b->num : a->num < b->num;
+        copyValue( op->dst, ok ? &trueValue : &falseValue );
+        if ( ok != op->taken )
+          return op->exit;
+        continue;
+      case OP_DIV:
+      case OP_MOD:
+      case OP_DIVMOD:
+        // Leave dividing by zero or -1 to the interpreter.
+        if ( b->num == 0 || b->num == -1 )
+          return op->pc;
+        if ( op->op == OP_DIVMOD ) {
+          int64_t quot = a->num / b->num;
+          int64_t rem = a->num % b->num;
+          storeInt( op->dst, quot );
+          storeInt( op->c, rem );
+          continue;
+        }
+        ans = op->op == OP_DIV ? a->num / b->num : a->num % b->num;
+        break;
+      case OP_ADD:
+        ok = !__builtin_add_overflow( a->num, b->num, &ans );
+        break;
+      case OP_SUB:
+        ok = !__builtin_sub_overflow( a->num, b->num, &ans );
+        break;
+      default:
+        ok = !__builtin_mul_overflow( a->num, b->num, &ans );
+        break;
+      }
+
+      if ( !ok && check )
+        return op->pc;
+
+      storeInt( op->dst, ans );
+    }
+  }
+}
+
+bool traceIsUseless( Trace const *trace )
+{
+  return trace->entries >= TRIAL_ENTRIES && trace->loops < trace->entries;
+}
+
+void freeTrace( Trace *trace )
+{
+  free( trace->ops );
+  free( trace );
+}
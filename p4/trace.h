@@ -0,0 +1,64 @@
+/**
+  @file trace.h
+  @author Prem Subedi
+  Traces, straight-line copies of the path through a hot loop, compiled
+  so they can run without going back to the interpreter each time
+  around the loop.
+*/
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include "bytecode.h"
+
+/** Longest path through a loop that will be made into a trace. */
+#define MAX_TRACE 64
+
+/** A compiled trace.  The fields are private to the trace component. */
+typedef struct TraceStruct Trace;
+
+/** One instruction that ran while a trace was being recorded. */
+typedef struct {
+  /** Index of the instruction. */
+  int pc;
+
+  /** Index of the instruction that ran after it. */
+  int next;
+} TraceStep;
+
+/** Compile a recorded path around a loop into a trace.  The path has
+    to end by going back to the instruction it started with.  The trace
+    refers directly to values in the given frame, so it can only be
+    used for the run the frame belongs to.
+    @param code program the path is from.
+    @param frame values for the run the trace is for.
+    @param steps instructions on the path, in the order they ran.
+    @param n number of steps, at most MAX_TRACE.
+    @return the new trace.
+*/
+Trace *compileTrace( Code const *code, Value *frame, TraceStep const *steps, int n );
+
+/** Run a trace over and over, until something happens that it wasn't
+    recorded for, like a branch going the other way or an operand that
+    isn't a number.  The instruction where that happens hasn't been
+    run yet, except for a branch, so the interpreter can just carry on
+    from there and handle it, including reporting any error.
+    @param trace trace to run.
+    @param out buffer for output from print.
+    @return index of the instruction to continue from.
+*/
+int runTrace( Trace *trace, Output *out );
+
+/** Return true if a trace usually leaves before getting around the
+    loop once, so it's not worth running.
+    @param trace trace to check.
+    @return true if the trace should be thrown away.
+*/
+bool traceIsUseless( Trace const *trace );
+
+/** Free the memory for a trace.
+    @param trace trace to free.
+*/
+void freeTrace( Trace *trace );
+
+#endif
@@ -0,0 +1,173 @@
+/**
+   @file value.c
+   @author Prem Subedi
+   This component keeps up with the variables and literals used in a
+   script, giving each one a slot so commands can refer to their values
+   by index instead of looking them up by name while the program runs.
+ */
+
+#include "value.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "parse.h"
+
+/** Initial capacity for the name and literal arrays. */
+#define CAPACITY 5
+
+Value const trueValue = { VAL_INT, true, 0, 1, { NULL } };
+
+Value const falseValue = { VAL_STR, false, 0, 0, { "" } };
+
+/**
+   Return the index of the given string in a list, adding it to the end
+   if it's not already there.
+   @param arena arena to copy new strings into.
+   @param list address of the resizable array of strings.
+   @param count address of the number of strings in the array.
+   @param cap address of the capacity of the array.
+   @param index map from each string to its index in the array.
+   @param str start of the string to look for.
+   @param len number of characters in the string.
+   @return index of the string.
+*/
+static int intern( Arena *arena, char ***list, int *count, int *cap, LabelMap *index,
+                   char const *str, int len )
+{
+  int i = findLabelLen( index, str, len );
+  if ( i >= 0 )
+    return i;
+
+  if ( *count >= *cap ) {
+    *cap *= 2;
+    *list = (char **) realloc( *list, *cap * sizeof( char * ) );
+  }
+  ( *list )[ *count ] = arenaCopy( arena, str, len );
+  addLabelLen( index, str, len, *count );
+  return ( *count )++;
+}
+
+bool parseNumber( char const *str, int len, int64_t *num )
+{
+  char const *p = str;
+  char const *end = str + len;
+  *num = 0;
+  while ( p < end && isspace( (unsigned char) *p ) )
+    p++;
+  bool neg = p < end && *p == '-';
+  if ( p < end && ( *p == '-' || *p == '+' ) )
+    p++;
+  if ( p == end || !isdigit( (unsigned char) *p ) )
+    return false;
+
+  // Add up the magnitude, and stop if it gets too big.
+  uint64_t limit = neg ? (uint64_t) INT64_MAX + 1 : INT64_MAX;
+  uint64_t mag = 0;
+  for ( ; p < end && isdigit( (unsigned char) *p ); p++ ) {
+    int d = *p - '0';
+    if ( mag > ( limit - d ) / 10 ) {
+      mag = limit;
+      break;
+    }
+    mag = mag * 10 + d;
+  }
+  *num = neg ? (int64_t) ( 0 - mag ) : (int64_t) mag;
+  return true;
+}
+
+Value makeStringValue( char const *str )
+{
+  Value v = { VAL_STR, false, 0, 0, { str } };
+  v.numeric = parseNumber( str, strlen( str ), &v.num );
+  return v;
+}
+
+void initVars( VarTable *vars, Arena *arena )
+{
+  vars->arena = arena;
+  vars->varCount = vars->constCount = 0;
+  vars->varCap = vars->constCap = CAPACITY;
+  vars->names = (char **) malloc( CAPACITY * sizeof( char * ) );
+  vars->consts = (char **) malloc( CAPACITY * sizeof( char * ) );
+  initMap( &vars->varIndex );
+  initMap( &vars->constIndex );
+}
+
+int internVar( VarTable *vars, char const *name, int len )
+{
+  return intern( vars->arena, &vars->names, &vars->varCount, &vars->varCap,
+                 &vars->varIndex, name, len );
+}
+
+int internLiteral( VarTable *vars, char const *text, int len )
+{
+  return -1 - intern( vars->arena, &vars->consts, &vars->constCount, &vars->constCap,
+                      &vars->constIndex, text, len );
+}
+
+int internOperand( VarTable *vars, char const *tok, int len )
+{
+  if ( isVarNameLen( tok, len ) )
+    return internVar( vars, tok, len );
+
+  // Anything else is a literal, skip the leading quote.
+  return internLiteral( vars, tok + 1, len - 1 );
+}
+
+int operandSlot( VarTable const *vars, int operand )
+{
+  return operand >= 0 ? operand : vars->varCount - 1 - operand;
+}
+
+char const *operandText( VarTable const *vars, int operand )
+{
+  return operand >= 0 ? vars->names[ operand ] : vars->consts[ -1 - operand ];
+}
+
+int frameSize( VarTable const *vars )
+{
+  return vars->varCount + vars->constCount;
+}
+
+/**
+   Return the value bound to the given name, in a list of NAME=value
+   strings.  If there's more than one, the first one wins, like getenv.
+   @param bindings NULL-terminated list of bindings.
+   @param name name to look for.
+   @return the value, or NULL if the name isn't bound.
+*/
+static char const *lookupBinding( char const *const *bindings, char const *name )
+{
+  int len = strlen( name );
+  for ( ; *bindings; bindings++ )
+    if ( strncmp( *bindings, name, len ) == 0 && ( *bindings )[ len ] == '=' )
+      return *bindings + len + 1;
+  return NULL;
+}
+
+void loadFrame( VarTable const *vars, Value *frame, char const *const *bindings )
+{
+  for ( int i = 0; i < vars->varCount; i++ ) {
+    char const *env = bindings ? lookupBinding( bindings, vars->names[ i ] )
+      : getenv( vars->names[ i ] );
+    if ( env )
+      frame[ i ] = makeStringValue( env );
+    else {
+      // Not numeric either, so checking that is enough to make sure
+      // a value can be used in arithmetic.
+      frame[ i ].type = VAL_UNDEF;
+      frame[ i ].numeric = false;
+    }
+  }
+
+  for ( int i = 0; i < vars->constCount; i++ )
+    frame[ vars->varCount + i ] = makeStringValue( vars->consts[ i ] );
+}
+
+void freeVars( VarTable *vars )
+{
+  free( vars->names );
+  free( vars->consts );
+  freeMap( &vars->varIndex );
+  freeMap( &vars->constIndex );
+}
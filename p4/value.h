@@ -0,0 +1,268 @@
+/**
+  @file value.h
+  @author Prem Subedi
+  Representation for the values held in variables, and the table that
+  assigns every variable and literal in a program its own numbered slot.
+*/
+
+#ifndef _VALUE_H_
+#define _VALUE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "label.h"
+#include "arena.h"
+
+/** Most characters a string can have and still be stored right in
+    its value, without allocating anything. */
+#define SMALL_STRING 15
+
+/** Kinds of value a slot can hold.  There are three kinds of string,
+    text we don't own, like a literal or an environment variable, a
+    short string stored in the value itself, and a string in shared,
+    reference-counted storage. */
+typedef enum { VAL_UNDEF, VAL_INT, VAL_STR, VAL_SMALL, VAL_SHARED } ValueType;
+
+/** Storage for a string too long to keep in a value.  The text never
+    changes once it's there, so any number of values can share it,
+    each looking at its own part of it.  Text can be added past the
+    end of what's in use, so a value that ends at the end of what's in
+    use can be appended to without copying it. */
+typedef struct {
+  /** Number of values using this storage. */
+  int refs;
+
+  /** Number of characters in use. */
+  int used;
+
+  /** Number of characters there's room for. */
+  int cap;
+
+  /** The characters, not null terminated. */
+  char data[];
+} StrBuf;
+
+/** A value stored in a variable.  Numbers computed by arithmetic stay
+    as integers, and are only turned into text when they're printed. */
+typedef struct {
+  /** What kind of value this is. */
+  ValueType type;
+
+  /** For strings, true if the text starts with an integer. */
+  bool numeric;
+
+  /** Number of characters in a VAL_SMALL string. */
+  unsigned char smallLen;
+
+  /** The integer value, for VAL_INT or for a numeric string.  This
+      is 64 bits everywhere, so counters and checksums don't depend
+      on the size of a long. */
+  int64_t num;
+
+  /** The text of a string value, depending on its type. */
+  union {
+    /** For VAL_STR, null-terminated text that isn't owned by the
+        value, it points to a literal or an environment variable. */
+    char const *str;
+
+    /** For VAL_SMALL, the characters themselves. */
+    char small[ SMALL_STRING + 1 ];
+
+    /** For VAL_SHARED, the storage, and the part of it this value
+        uses.  The value holds one reference to the storage. */
+    struct {
+      StrBuf *buf;
+      int start;
+      int len;
+    } shared;
+  } text;
+} Value;
+
+/** Value comparisons store for true. */
+extern Value const trueValue;
+
+/** Value comparisons store for false, the empty string. */
+extern Value const falseValue;
+
+/** Table of all the variable names and literals used in a program.
+    Variables get slots 0 through varCount - 1, and literals come
+    right after them, so every operand is just an index into one
+    array of values. */
+typedef struct {
+  /** Names of all the variables, indexed by slot. */
+  char **names;
+
+  /** Number of variables in the table. */
+  int varCount;
+
+  /** Capacity of the names array. */
+  int varCap;
+
+  /** Text of all the literals, without their leading double quote. */
+  char **consts;
+
+  /** Number of literals in the table. */
+  int constCount;
+
+  /** Capacity of the consts array. */
+  int constCap;
+
+  /** Map from each variable name to its slot. */
+  LabelMap varIndex;
+
+  /** Map from the text of each literal to its index in consts. */
+  LabelMap constIndex;
+
+  /** Arena the names and the text of the literals are stored in. */
+  Arena *arena;
+} VarTable;
+
+/** Work out the integer a string starts with, the same way sscanf's
+    %ld would with a 64-bit long.  Numbers too big for 64 bits are
+    clamped to the largest or smallest value.  This stops once it
+    knows the value, so it's quick even for a long string of digits.
+    @param str start of the text, which needn't be null terminated.
+    @param len number of characters in the text.
+    @param num storage for the integer, or 0 if there isn't one.
+    @return true if the text starts with an integer.
+*/
+bool parseNumber( char const *str, int len, int64_t *num );
+
+/** Make a string value for the given text, working out its integer
+    value with parseNumber().
+    @param str text for the value.
+    @return the new value.
+*/
+Value makeStringValue( char const *str );
+
+/** Drop a value's reference to its shared storage, if it has one,
+    before it's overwritten or thrown away.
+    @param v value that's going away.
+*/
+static inline void dropValue( Value *v )
+{
+  if ( v->type == VAL_SHARED && --v->text.shared.buf->refs == 0 )
+    free( v->text.shared.buf );
+}
+
+/** Copy one value over another, keeping the reference counts right.
+    @param dest value to overwrite.
+    @param src value to copy.
+*/
+static inline void copyValue( Value *dest, Value const *src )
+{
+  // Count the new reference first, in case they're the same value.
+  if ( src->type == VAL_SHARED )
+    src->text.shared.buf->refs++;
+  dropValue( dest );
+  *dest = *src;
+}
+
+/** Store an integer in a value.
+    @param dest value to overwrite.
+    @param num the integer.
+*/
+static inline void storeInt( Value *dest, int64_t num )
+{
+  dropValue( dest );
+  dest->type = VAL_INT;
+  dest->numeric = true;
+  dest->num = num;
+}
+
+/** Return the text of a string value.
+    @param v value of any string type.
+    @param len storage for the number of characters.
+    @return start of the text, which may not be null terminated.
+*/
+static inline char const *stringText( Value const *v, int *len )
+{
+  if ( v->type == VAL_SMALL ) {
+    *len = v->smallLen;
+    return v->text.small;
+  }
+  if ( v->type == VAL_SHARED ) {
+    *len = v->text.shared.len;
+    return v->text.shared.buf->data + v->text.shared.start;
+  }
+  *len = strlen( v->text.str );
+  return v->text.str;
+}
+
+/** Initialize the fields of the given variable table.
+    @param vars Address of the structure to initialize.
+    @param arena Arena for copies of the names and literals, which
+    are freed along with the arena rather than by freeVars().
+*/
+void initVars( VarTable *vars, Arena *arena );
+
+/** Return the operand code for the given token, a variable name or a
+    literal with its leading double quote.  Variables are given
+    non-negative codes, the same as their slot.  Literals are given
+    negative codes, since their slots aren't known until the whole
+    program has been parsed.
+    @param vars Table to add the variable or literal to.
+    @param tok Start of the token's text, which needn't be null terminated.
+    @param len Number of characters in the token.
+    @return operand code for the token.
+*/
+int internOperand( VarTable *vars, char const *tok, int len );
+
+/** Return the slot for the given variable name, always treating it as
+    a variable, as for the destination of a command.
+    @param vars Table to add the variable to.
+    @param name Start of the name of the variable.
+    @param len Number of characters in the name.
+    @return slot for the variable.
+*/
+int internVar( VarTable *vars, char const *name, int len );
+
+/** Return the operand code for a literal with the given text.
+    @param vars Table to add the literal to.
+    @param text Start of the literal's text, without a leading quote.
+    @param len Number of characters in the text.
+    @return operand code for the literal.
+*/
+int internLiteral( VarTable *vars, char const *text, int len );
+
+/** Return the slot for an operand code returned by internOperand().
+    @param vars Table the operand was interned in.
+    @param operand Operand code.
+    @return Index of the operand's value in the frame.
+*/
+int operandSlot( VarTable const *vars, int operand );
+
+/** Return the text for an operand code, the name of a variable or
+    the contents of a literal.
+    @param vars Table the operand was interned in.
+    @param operand Operand code.
+    @return text of the operand.
+*/
+char const *operandText( VarTable const *vars, int operand );
+
+/** Return the number of slots needed to run a program using this table.
+    @param vars Table of variables and literals.
+    @return number of values in a frame.
+*/
+int frameSize( VarTable const *vars );
+
+/** Fill in the starting values for a run of the program.  Literals
+    get their values, and each variable gets its value from the
+    bindings, or is left undefined if it isn't bound.
+    @param vars Table of variables and literals.
+    @param frame Array of frameSize() values to fill in.
+    @param bindings NULL-terminated list of NAME=value strings, like
+    the environment.  If this is NULL, the variables get their values
+    from the environment.
+*/
+void loadFrame( VarTable const *vars, Value *frame, char const *const *bindings );
+
+/** Free the memory used by the variable table, other than what's in
+    its arena.
+    @param vars Table to free.
+*/
+void freeVars( VarTable *vars );
+
+#endif